@@ -5,8 +5,19 @@
  * Compiler version: clang 13.1.6
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#endif
 
 int compare_ints(void const* a_ptr, void const* b_ptr) {
     int a = *(int const*)a_ptr;
@@ -14,24 +25,373 @@ int compare_ints(void const* a_ptr, void const* b_ptr) {
     return (a > b) - (b > a);
 }
 
+/**
+ * Smallest and largest supported tuple sizes.
+ */
+#define MIN_TUPLE_SIZE 3
+#define MAX_TUPLE_SIZE 16
+
+/**
+ * Sorting networks, as lists of comparators CX(i, j), each putting the smaller of the elements
+ * i and j first. These are Batcher's odd-even merge sorts for the next power of two,
+ * with all comparators touching the missing inputs removed (which is the same as padding
+ * the input with +infinity), all checked against every 0-1 input.
+ */
+#define NETWORK_3(CX)          \
+    CX(0, 1) CX(0, 2) CX(1, 2)
+#define NETWORK_4(CX)                            \
+    CX(0, 1) CX(2, 3) CX(0, 2) CX(1, 3) CX(1, 2)
+#define NETWORK_5(CX)                                                                \
+    CX(0, 1) CX(2, 3) CX(0, 2) CX(1, 3) CX(1, 2) CX(0, 4) CX(2, 4) CX(1, 2) CX(3, 4)
+#define NETWORK_6(CX)                                                                \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(0, 2) CX(1, 3) CX(1, 2) CX(0, 4) CX(1, 5) CX(2, 4) \
+    CX(3, 5) CX(1, 2) CX(3, 4)
+#define NETWORK_7(CX)                                                                \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(0, 2) CX(1, 3) CX(4, 6) CX(1, 2) CX(5, 6) CX(0, 4) \
+    CX(1, 5) CX(2, 6) CX(2, 4) CX(3, 5) CX(1, 2) CX(3, 4) CX(5, 6)
+#define NETWORK_8(CX)                                                                \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(0, 2) CX(1, 3) CX(4, 6) CX(5, 7) CX(1, 2) \
+    CX(5, 6) CX(0, 4) CX(1, 5) CX(2, 6) CX(3, 7) CX(2, 4) CX(3, 5) CX(1, 2) CX(3, 4) \
+    CX(5, 6)
+#define NETWORK_9(CX)                                                                \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(0, 2) CX(1, 3) CX(4, 6) CX(5, 7) CX(1, 2) \
+    CX(5, 6) CX(0, 4) CX(1, 5) CX(2, 6) CX(3, 7) CX(2, 4) CX(3, 5) CX(1, 2) CX(3, 4) \
+    CX(5, 6) CX(0, 8) CX(4, 8) CX(2, 4) CX(3, 5) CX(6, 8) CX(1, 2) CX(3, 4) CX(5, 6) \
+    CX(7, 8)
+#define NETWORK_10(CX)                                                               \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(8, 9) CX(0, 2) CX(1, 3) CX(4, 6) CX(5, 7) \
+    CX(1, 2) CX(5, 6) CX(0, 4) CX(1, 5) CX(2, 6) CX(3, 7) CX(2, 4) CX(3, 5) CX(1, 2) \
+    CX(3, 4) CX(5, 6) CX(0, 8) CX(1, 9) CX(4, 8) CX(5, 9) CX(2, 4) CX(3, 5) CX(6, 8) \
+    CX(7, 9) CX(1, 2) CX(3, 4) CX(5, 6) CX(7, 8)
+#define NETWORK_11(CX)                                                                 \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(8, 9) CX(0, 2) CX(1, 3) CX(4, 6) CX(5, 7)   \
+    CX(8, 10) CX(1, 2) CX(5, 6) CX(9, 10) CX(0, 4) CX(1, 5) CX(2, 6) CX(3, 7) CX(2, 4) \
+    CX(3, 5) CX(1, 2) CX(3, 4) CX(5, 6) CX(9, 10) CX(0, 8) CX(1, 9) CX(2, 10) CX(4, 8) \
+    CX(5, 9) CX(6, 10) CX(2, 4) CX(3, 5) CX(6, 8) CX(7, 9) CX(1, 2) CX(3, 4) CX(5, 6)  \
+    CX(7, 8) CX(9, 10)
+#define NETWORK_12(CX)                                                                   \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(8, 9) CX(10, 11) CX(0, 2) CX(1, 3) CX(4, 6)   \
+    CX(5, 7) CX(8, 10) CX(9, 11) CX(1, 2) CX(5, 6) CX(9, 10) CX(0, 4) CX(1, 5) CX(2, 6)  \
+    CX(3, 7) CX(2, 4) CX(3, 5) CX(1, 2) CX(3, 4) CX(5, 6) CX(9, 10) CX(0, 8) CX(1, 9)    \
+    CX(2, 10) CX(3, 11) CX(4, 8) CX(5, 9) CX(6, 10) CX(7, 11) CX(2, 4) CX(3, 5) CX(6, 8) \
+    CX(7, 9) CX(1, 2) CX(3, 4) CX(5, 6) CX(7, 8) CX(9, 10)
+#define NETWORK_13(CX)                                                                     \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(8, 9) CX(10, 11) CX(0, 2) CX(1, 3) CX(4, 6)     \
+    CX(5, 7) CX(8, 10) CX(9, 11) CX(1, 2) CX(5, 6) CX(9, 10) CX(0, 4) CX(1, 5) CX(2, 6)    \
+    CX(3, 7) CX(8, 12) CX(2, 4) CX(3, 5) CX(10, 12) CX(1, 2) CX(3, 4) CX(5, 6) CX(9, 10)   \
+    CX(11, 12) CX(0, 8) CX(1, 9) CX(2, 10) CX(3, 11) CX(4, 12) CX(4, 8) CX(5, 9) CX(6, 10) \
+    CX(7, 11) CX(2, 4) CX(3, 5) CX(6, 8) CX(7, 9) CX(10, 12) CX(1, 2) CX(3, 4) CX(5, 6)    \
+    CX(7, 8) CX(9, 10) CX(11, 12)
+#define NETWORK_14(CX)                                                                     \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(8, 9) CX(10, 11) CX(12, 13) CX(0, 2) CX(1, 3)   \
+    CX(4, 6) CX(5, 7) CX(8, 10) CX(9, 11) CX(1, 2) CX(5, 6) CX(9, 10) CX(0, 4) CX(1, 5)    \
+    CX(2, 6) CX(3, 7) CX(8, 12) CX(9, 13) CX(2, 4) CX(3, 5) CX(10, 12) CX(11, 13) CX(1, 2) \
+    CX(3, 4) CX(5, 6) CX(9, 10) CX(11, 12) CX(0, 8) CX(1, 9) CX(2, 10) CX(3, 11) CX(4, 12) \
+    CX(5, 13) CX(4, 8) CX(5, 9) CX(6, 10) CX(7, 11) CX(2, 4) CX(3, 5) CX(6, 8) CX(7, 9)    \
+    CX(10, 12) CX(11, 13) CX(1, 2) CX(3, 4) CX(5, 6) CX(7, 8) CX(9, 10) CX(11, 12)
+#define NETWORK_15(CX)                                                                      \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(8, 9) CX(10, 11) CX(12, 13) CX(0, 2) CX(1, 3)    \
+    CX(4, 6) CX(5, 7) CX(8, 10) CX(9, 11) CX(12, 14) CX(1, 2) CX(5, 6) CX(9, 10) CX(13, 14) \
+    CX(0, 4) CX(1, 5) CX(2, 6) CX(3, 7) CX(8, 12) CX(9, 13) CX(10, 14) CX(2, 4) CX(3, 5)    \
+    CX(10, 12) CX(11, 13) CX(1, 2) CX(3, 4) CX(5, 6) CX(9, 10) CX(11, 12) CX(13, 14)        \
+    CX(0, 8) CX(1, 9) CX(2, 10) CX(3, 11) CX(4, 12) CX(5, 13) CX(6, 14) CX(4, 8) CX(5, 9)   \
+    CX(6, 10) CX(7, 11) CX(2, 4) CX(3, 5) CX(6, 8) CX(7, 9) CX(10, 12) CX(11, 13) CX(1, 2)  \
+    CX(3, 4) CX(5, 6) CX(7, 8) CX(9, 10) CX(11, 12) CX(13, 14)
+#define NETWORK_16(CX)                                                                      \
+    CX(0, 1) CX(2, 3) CX(4, 5) CX(6, 7) CX(8, 9) CX(10, 11) CX(12, 13) CX(14, 15) CX(0, 2)  \
+    CX(1, 3) CX(4, 6) CX(5, 7) CX(8, 10) CX(9, 11) CX(12, 14) CX(13, 15) CX(1, 2) CX(5, 6)  \
+    CX(9, 10) CX(13, 14) CX(0, 4) CX(1, 5) CX(2, 6) CX(3, 7) CX(8, 12) CX(9, 13) CX(10, 14) \
+    CX(11, 15) CX(2, 4) CX(3, 5) CX(10, 12) CX(11, 13) CX(1, 2) CX(3, 4) CX(5, 6) CX(9, 10) \
+    CX(11, 12) CX(13, 14) CX(0, 8) CX(1, 9) CX(2, 10) CX(3, 11) CX(4, 12) CX(5, 13)         \
+    CX(6, 14) CX(7, 15) CX(4, 8) CX(5, 9) CX(6, 10) CX(7, 11) CX(2, 4) CX(3, 5) CX(6, 8)    \
+    CX(7, 9) CX(10, 12) CX(11, 13) CX(1, 2) CX(3, 4) CX(5, 6) CX(7, 8) CX(9, 10) CX(11, 12) \
+    CX(13, 14)
+
+/**
+ * Number of tuples sorted at once by the vectorized sorters, one per SIMD lane.
+ */
+#define TUPLE_LANES 8
+
+/**
+ * Branchless comparator of a single tuple x.
+ */
+#define CX_SCALAR(i, j)           \
+    {                             \
+        int a_ = x[i], b_ = x[j]; \
+        x[i] = a_ < b_ ? a_ : b_; \
+        x[j] = a_ < b_ ? b_ : a_; \
+    }
+
+/**
+ * Comparator of TUPLE_LANES tuples at once, laid out by column in v, which the compiler turns
+ * into a single pair of min/max instructions.
+ */
+#define CX_LANES(i, j)                            \
+    for (size_t l_ = 0; l_ < TUPLE_LANES; ++l_) { \
+        int a_ = v[i][l_], b_ = v[j][l_];         \
+        v[i][l_] = a_ < b_ ? a_ : b_;             \
+        v[j][l_] = a_ < b_ ? b_ : a_;             \
+    }
+
+/**
+ * Generates the sorter of `count` consecutive tuples of N ints. Blocks of TUPLE_LANES tuples
+ * are transposed, so that every lane holds one tuple, and sorted by the network all at once;
+ * the remaining tuples are sorted one at a time.
+ */
+#define DEFINE_TUPLE_SORTER(N, NAME, ATTRIBUTES)                                     \
+    ATTRIBUTES static void NAME(int* tuples, size_t count) {                         \
+        size_t t = 0;                                                                \
+        for (; t + TUPLE_LANES <= count; t += TUPLE_LANES) {                         \
+            int* block = tuples + t * N;                                             \
+            int v[N][TUPLE_LANES];                                                   \
+            for (size_t k = 0; k < N; ++k) {                                         \
+                for (size_t l = 0; l < TUPLE_LANES; ++l) v[k][l] = block[l * N + k]; \
+            }                                                                        \
+            NETWORK_##N(CX_LANES);                                                   \
+            for (size_t k = 0; k < N; ++k) {                                         \
+                for (size_t l = 0; l < TUPLE_LANES; ++l) block[l * N + k] = v[k][l]; \
+            }                                                                        \
+        }                                                                            \
+        for (; t < count; ++t) {                                                     \
+            int* x = tuples + t * N;                                                 \
+            NETWORK_##N(CX_SCALAR);                                                  \
+        }                                                                            \
+    }
+
+#ifdef HAVE_X86_SIMD
+#define DEFINE_TUPLE_SORTERS(N)                                                     \
+    DEFINE_TUPLE_SORTER(N, sort_tuples_##N, )                                       \
+    DEFINE_TUPLE_SORTER(N, sort_tuples_##N##_avx2, __attribute__((target("avx2"))))
+#else
+#define DEFINE_TUPLE_SORTERS(N) DEFINE_TUPLE_SORTER(N, sort_tuples_##N, )
+#endif
+
+DEFINE_TUPLE_SORTERS(3)
+DEFINE_TUPLE_SORTERS(4)
+DEFINE_TUPLE_SORTERS(5)
+DEFINE_TUPLE_SORTERS(6)
+DEFINE_TUPLE_SORTERS(7)
+DEFINE_TUPLE_SORTERS(8)
+DEFINE_TUPLE_SORTERS(9)
+DEFINE_TUPLE_SORTERS(10)
+DEFINE_TUPLE_SORTERS(11)
+DEFINE_TUPLE_SORTERS(12)
+DEFINE_TUPLE_SORTERS(13)
+DEFINE_TUPLE_SORTERS(14)
+DEFINE_TUPLE_SORTERS(15)
+DEFINE_TUPLE_SORTERS(16)
+
+typedef void (*tuple_sorter)(int* tuples, size_t count);
+
+static tuple_sorter const tuple_sorters[MAX_TUPLE_SIZE + 1] = {
+    [3] = sort_tuples_3,   [4] = sort_tuples_4,   [5] = sort_tuples_5,   [6] = sort_tuples_6,
+    [7] = sort_tuples_7,   [8] = sort_tuples_8,   [9] = sort_tuples_9,   [10] = sort_tuples_10,
+    [11] = sort_tuples_11, [12] = sort_tuples_12, [13] = sort_tuples_13, [14] = sort_tuples_14,
+    [15] = sort_tuples_15, [16] = sort_tuples_16,
+};
+
+#ifdef HAVE_X86_SIMD
+static tuple_sorter const tuple_sorters_avx2[MAX_TUPLE_SIZE + 1] = {
+    [3] = sort_tuples_3_avx2,   [4] = sort_tuples_4_avx2,   [5] = sort_tuples_5_avx2,
+    [6] = sort_tuples_6_avx2,   [7] = sort_tuples_7_avx2,   [8] = sort_tuples_8_avx2,
+    [9] = sort_tuples_9_avx2,   [10] = sort_tuples_10_avx2, [11] = sort_tuples_11_avx2,
+    [12] = sort_tuples_12_avx2, [13] = sort_tuples_13_avx2, [14] = sort_tuples_14_avx2,
+    [15] = sort_tuples_15_avx2, [16] = sort_tuples_16_avx2,
+};
+#endif
+
+/**
+ * Returns the fastest sorter of tuples of the given size supported by the CPU.
+ */
+tuple_sorter pick_tuple_sorter(size_t size, char const** out_name) {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *out_name = "network (avx2)";
+        return tuple_sorters_avx2[size];
+    }
+#endif
+    *out_name = "network";
+    return tuple_sorters[size];
+}
+
+/**
+ * Parses a whole string as an int. Returns false if it isn't one, or if it's out of range.
+ * Used for both the numbers from the command line and the tuples read by read_ints.
+ */
+bool parse_int(char const* arg, int* out) {
+    char* end;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE || value < INT_MIN || value > INT_MAX)
+        return false;
+    *out = (int)value;
+    return true;
+}
+
+/**
+ * Reads all whitespace-separated ints from the file, exiting on anything that isn't one.
+ */
+int* read_ints(FILE* fp, size_t* out_count) {
+    size_t count = 0, capacity = 1024;
+    int* nums = malloc(capacity * sizeof(int));
+    if (!nums) {
+        fputs("hw1-2: out of memory\n", stderr);
+        exit(1);
+    }
+
+    // Longer tokens can't be ints, and are rejected by the length check
+    char token[32];
+    int num;
+    while (fscanf(fp, "%31s", token) == 1) {
+        if (strlen(token) == sizeof(token) - 1 || !parse_int(token, &num)) {
+            fprintf(stderr, "hw1-2: malformed number \"%s\"\n", token);
+            exit(1);
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            nums = realloc(nums, capacity * sizeof(int));
+            if (!nums) {
+                fputs("hw1-2: out of memory\n", stderr);
+                exit(1);
+            }
+        }
+        nums[count++] = num;
+    }
+
+    if (!feof(fp)) {
+        fputs("hw1-2: malformed input\n", stderr);
+        exit(1);
+    }
+
+    *out_count = count;
+    return nums;
+}
+
+/**
+ * Returns a monotonic timestamp in seconds, for benchmarking.
+ */
+double now_in_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Times the sorting network against sorting every tuple with qsort,
+ * verifying both give the same results, and prints the results to stderr.
+ */
+void benchmark_tuples(int const* nums, size_t tuples, size_t size) {
+    size_t count = tuples * size;
+    int* by_network = malloc(count * sizeof(int));
+    int* by_qsort = malloc(count * sizeof(int));
+    if (!by_network || !by_qsort) {
+        fputs("hw1-2: out of memory\n", stderr);
+        exit(1);
+    }
+    memcpy(by_network, nums, count * sizeof(int));
+    memcpy(by_qsort, nums, count * sizeof(int));
+
+    char const* name;
+    tuple_sorter sorter = pick_tuple_sorter(size, &name);
+    double start = now_in_sec();
+    sorter(by_network, tuples);
+    double time_network = now_in_sec() - start;
+
+    start = now_in_sec();
+    for (size_t t = 0; t < tuples; ++t)
+        qsort(by_qsort + t * size, size, sizeof(int), compare_ints);
+    double time_qsort = now_in_sec() - start;
+
+    if (memcmp(by_network, by_qsort, count * sizeof(int)) != 0) {
+        fputs("hw1-2: sorting network and qsort disagree\n", stderr);
+        exit(1);
+    }
+
+    fprintf(stderr, "method\tseconds\tMtuples/s\n");
+    fprintf(stderr, "%s\t%.4f\t%.1f\n", name, time_network, tuples / time_network * 1e-6);
+    fprintf(stderr, "qsort\t%.4f\t%.1f\n", time_qsort, tuples / time_qsort * 1e-6);
+    fprintf(stderr, "speedup\t%.2fx\n", time_qsort / time_network);
+
+    free(by_network);
+    free(by_qsort);
+}
+
+void print_usage_and_exit(void) {
+    fputs(
+        "Usage: ./hw1-2 number_1 number_2 number_3\n"
+        "       ./hw1-2 -n size [-b] [filename]\n"
+        "\n"
+        "  -n  sort a stream of whitespace-separated tuples of that many ints (3 to 16),\n"
+        "      read from filename, or stdin if it's missing or \"-\"; prints one tuple per line\n"
+        "  -b  benchmark sorting the tuples against qsort, instead of printing them\n",
+        stderr);
+    exit(1);
+}
+
 int main(int argc, char** argv) {
+    // Sort three numbers from the command line, validated like the tuples of -n,
+    // unless any of them is not a number - like in "-n3 -b file"
+    int numbers[3];
+    if (argc == 4 && parse_int(argv[1], numbers) && parse_int(argv[2], numbers + 1) &&
+        parse_int(argv[3], numbers + 2)) {
+        // Sort the list
+        qsort(numbers, 3, sizeof(int), compare_ints);
+
+        // Print the result
+        printf("%d %d %d\n", numbers[0], numbers[1], numbers[2]);
+
+        return 0;
+    }
+
     // Check the arguments
-    if (argc != 4) {
-        fputs("Usage: ./hw1-2 number_1 number_2 number_3\n", stderr);
-        return 1;
+    size_t size = 0;
+    bool benchmark = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "bn:")) != -1) {
+        switch (opt) {
+            case 'b':
+                benchmark = true;
+                break;
+            case 'n':
+                size = (size_t)atoi(optarg);
+                break;
+            default:
+                print_usage_and_exit();
+        }
     }
+    if (size < MIN_TUPLE_SIZE || size > MAX_TUPLE_SIZE || argc - optind > 1)
+        print_usage_and_exit();
 
-    // Convert the arguments to numbers
-    int numbers[3];
-    numbers[0] = atoi(argv[1]);
-    numbers[1] = atoi(argv[2]);
-    numbers[2] = atoi(argv[3]);
+    // Read the tuples
+    FILE* fp = stdin;
+    if (optind < argc && strcmp(argv[optind], "-") != 0) {
+        fp = fopen(argv[optind], "r");
+        if (!fp) {
+            perror("fopen");
+            return 1;
+        }
+    }
 
-    // Sort the list
-    qsort(numbers, 3, sizeof(int), compare_ints);
+    size_t count;
+    int* nums = read_ints(fp, &count);
+    if (fp != stdin) fclose(fp);
+    if (count % size != 0) {
+        fprintf(stderr, "hw1-2: %zu numbers don't make whole tuples of %zu\n", count, size);
+        return 1;
+    }
 
-    // Print the result
-    printf("%d %d %d\n", numbers[0], numbers[1], numbers[2]);
+    // Sort the tuples
+    size_t tuples = count / size;
+    if (benchmark) {
+        benchmark_tuples(nums, tuples, size);
+    } else {
+        char const* name;
+        pick_tuple_sorter(size, &name)(nums, tuples);
+        for (size_t i = 0; i < count; ++i)
+            printf("%d%c", nums[i], i % size == size - 1 ? '\n' : ' ');
+    }
 
+    free(nums);
     return 0;
 }
@@ -5,24 +5,124 @@
  * Compiler version: clang 13.1.6
  */
 
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdnoreturn.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/**
+ * Prints the provided printf-style message to stderr followed by a newline,
+ * then terminates the program by calling exit.
+ */
+noreturn void exit_with_message(char const* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+/**
+ * Number of independent accumulators used by find_mean and find_variance.
+ * Separate lanes break the dependency chain of a single running sum,
+ * and are laid out so that the compiler can keep them in vector registers.
+ */
+#define SUM_LANES 8
+
+/**
+ * Number of values find_mean sums in 64-bit integer lanes before adding them to the total.
+ */
+#define SUM_BLOCK_SIZE 4096
+
+/**
+ * Sums the numbers exactly: blocks are accumulated in 64-bit integer lanes (which can't overflow),
+ * and the block sums in a 128-bit total, so the only rounding happens in the final division.
+ */
 double find_mean(size_t nums_count, int* nums) {
-    double sum = 0.0;
-    for (size_t i = 0; i < nums_count; ++i) sum += (double)nums[i];
-    return sum / (double)nums_count;
+    __int128 total = 0;
+    for (size_t start = 0; start < nums_count; start += SUM_BLOCK_SIZE) {
+        size_t end = nums_count - start < SUM_BLOCK_SIZE ? nums_count : start + SUM_BLOCK_SIZE;
+        int64_t lanes[SUM_LANES] = {0};
+
+        size_t i = start;
+        for (; i + SUM_LANES <= end; i += SUM_LANES) {
+            for (size_t l = 0; l < SUM_LANES; ++l) lanes[l] += nums[i + l];
+        }
+        for (; i < end; ++i) lanes[0] += nums[i];
+
+        for (size_t l = 0; l < SUM_LANES; ++l) total += lanes[l];
+    }
+    return (double)((long double)total / (long double)nums_count);
+}
+
+/**
+ * Adds `value` to a Kahan-compensated sum, where `compensation`
+ * holds the low-order bits lost by the previous additions.
+ */
+static inline void kahan_add(double* sum, double* compensation, double value) {
+    double y = value - *compensation;
+    double t = *sum + y;
+    *compensation = (t - *sum) - y;
+    *sum = t;
 }
 
+/**
+ * Two-pass variance around the provided mean, using blocked summation: each block
+ * of SUM_BLOCK_SIZE squared deviations is summed in SUM_LANES independent lanes,
+ * and the block sums are added to a Kahan-compensated total, which bounds the error
+ * by the length of a lane instead of the whole array. The sum of the deviations themselves
+ * corrects for the rounding error of the mean (corrected two-pass algorithm).
+ */
 double find_variance(size_t nums_count, int* nums, double mean) {
-    double sum = 0.0;
-    for (size_t i = 0; i < nums_count; ++i) {
-        double i_diff = nums[i] - mean;
-        sum += i_diff * i_diff;
+    double sum_sq = 0.0, sum_sq_c = 0.0, sum_dev = 0.0, sum_dev_c = 0.0;
+
+    for (size_t start = 0; start < nums_count; start += SUM_BLOCK_SIZE) {
+        size_t end = nums_count - start < SUM_BLOCK_SIZE ? nums_count : start + SUM_BLOCK_SIZE;
+        double sq[SUM_LANES] = {0}, dev[SUM_LANES] = {0};
+
+        size_t i = start;
+        for (; i + SUM_LANES <= end; i += SUM_LANES) {
+            for (size_t l = 0; l < SUM_LANES; ++l) {
+                double i_diff = nums[i + l] - mean;
+                sq[l] += i_diff * i_diff;
+                dev[l] += i_diff;
+            }
+        }
+        for (; i < end; ++i) {
+            double i_diff = nums[i] - mean;
+            sq[0] += i_diff * i_diff;
+            dev[0] += i_diff;
+        }
+
+        for (size_t l = 0; l < SUM_LANES; ++l) {
+            kahan_add(&sum_sq, &sum_sq_c, sq[l]);
+            kahan_add(&sum_dev, &sum_dev_c, dev[l]);
+        }
     }
-    return sum / (double)nums_count;
+
+    double n = (double)nums_count;
+    return (sum_sq - sum_dev * sum_dev / n) / n;
 }
 
 int find_min(size_t nums_count, int* nums) {
@@ -69,30 +169,4126 @@ void load_numbers(char const* filename, size_t* out_nums_count, int** out_nums)
     *out_nums = nums;
 }
 
-int main(int argc, char** argv) {
-    // Check the arguments
-    if (argc != 2) {
-        fputs("Usage: ./hw1-3 filename\n", stderr);
-        exit(1);
+/**
+ * Running statistics of a sequence of numbers, updated one value at a time,
+ * so that no values need to be kept around.
+ *
+ * Welford's update of a running mean and M2 rounds on every step, which flips
+ * the last printed digit on inputs like input10.txt (variance 717.85).
+ * As the inputs are integers, exact 128-bit running sums are kept instead,
+ * and the only rounding happens when the mean and variance are extracted.
+ */
+struct moments {
+    size_t count;
+    int min;
+    int max;
+    __int128 sum;
+    unsigned __int128 sum_sq;
+};
+
+void moments_init(struct moments* m) {
+    m->count = 0;
+    m->min = INT_MAX;
+    m->max = INT_MIN;
+    m->sum = 0;
+    m->sum_sq = 0;
+}
+
+static inline void moments_push(struct moments* m, int x) {
+    m->count++;
+    if (x < m->min) m->min = x;
+    if (x > m->max) m->max = x;
+    m->sum += x;
+    m->sum_sq += (unsigned __int128)((long long)x * x);
+}
+
+double moments_mean(struct moments const* m) {
+    return (double)((long double)m->sum / (long double)m->count);
+}
+
+double moments_variance(struct moments const* m) {
+    if (m->count == 0) return 0.0 / (double)m->count;  // NaN, same as find_variance
+    long double n = (long double)m->count;
+
+    // Fall back to floating point if sum^2 could overflow 128 bits
+    unsigned __int128 sum_abs = (unsigned __int128)m->sum;
+    if (m->sum < 0) sum_abs = -sum_abs;
+    if (sum_abs >> 63) {
+        long double mean = (long double)m->sum / n;
+        return (double)((long double)m->sum_sq / n - mean * mean);
     }
 
-    // Load the numbers
-    size_t nums_count = 0;
-    int* nums = NULL;
-    load_numbers(argv[1], &nums_count, &nums);
+    // n * variance = sum_sq - sum^2 / n, with sum^2 / n split into q + r / n
+    unsigned __int128 sum_squared = sum_abs * sum_abs;
+    unsigned __int128 q = sum_squared / m->count;
+    unsigned __int128 r = sum_squared % m->count;
+    return (double)(((long double)(m->sum_sq - q) - (long double)r / n) / n);
+}
 
-    // Find the requested numeric data
-    int min = find_min(nums_count, nums);
-    int max = find_max(nums_count, nums);
-    double mean = find_mean(nums_count, nums);
-    double variance = find_variance(nums_count, nums, mean);
+void moments_merge(struct moments* into, struct moments const* from) {
+    into->count += from->count;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+    into->sum += from->sum;
+    into->sum_sq += from->sum_sq;
+}
 
-    // Print the results
-    puts("#data\tmin\tmax\tmean\tvariance");
-    printf("%zu\t%d\t%d\t%.1f\t%.1f\n", nums_count, min, max, mean, variance);
+/**
+ * Maximum number of values passed to a single block kernel call.
+ *
+ * The kernels keep the sums in 64-bit lanes, splitting every square into its
+ * low and high 32 bits, so each lane grows by less than 2^33 per value;
+ * blocks of this size can never overflow them.
+ */
+#define REDUCE_BLOCK_SIZE (1 << 16)
+
+/**
+ * A block kernel folds up to REDUCE_BLOCK_SIZE values into the moments,
+ * computing min, max, sum and sum of squares in a single fused pass.
+ */
+typedef void (*block_kernel)(struct moments* m, int const* x, size_t n);
+
+static void moments_add_block_scalar(struct moments* m, int const* x, size_t n) {
+    int min = m->min;
+    int max = m->max;
+    long long sum = 0;
+    unsigned long long sq_lo = 0;
+    unsigned long long sq_hi = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (x[i] < min) min = x[i];
+        if (x[i] > max) max = x[i];
+        sum += x[i];
+        unsigned long long sq = (unsigned long long)((long long)x[i] * x[i]);
+        sq_lo += sq & 0xFFFFFFFFu;
+        sq_hi += sq >> 32;
+    }
+
+    m->count += n;
+    m->min = min;
+    m->max = max;
+    m->sum += sum;
+    m->sum_sq += ((unsigned __int128)sq_hi << 32) + sq_lo;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * Adds 64-bit lane accumulators, gathered by the SIMD kernels, to the moments.
+ */
+static void moments_add_lanes(struct moments* m, size_t lanes, long long const* sum,
+                              unsigned long long const* sq_lo, unsigned long long const* sq_hi) {
+    for (size_t i = 0; i < lanes; ++i) {
+        m->sum += sum[i];
+        m->sum_sq += ((unsigned __int128)sq_hi[i] << 32) + sq_lo[i];
+    }
+}
+
+__attribute__((target("avx2"))) static void moments_add_block_avx2(struct moments* m,
+                                                                   int const* x, size_t n) {
+    __m256i min = _mm256_set1_epi32(m->min);
+    __m256i max = _mm256_set1_epi32(m->max);
+    __m256i sum = _mm256_setzero_si256();
+    __m256i sq_lo = _mm256_setzero_si256();
+    __m256i sq_hi = _mm256_setzero_si256();
+    __m256i low_half = _mm256_set1_epi64x(0xFFFFFFFF);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((__m256i const*)(x + i));
+        min = _mm256_min_epi32(min, v);
+        max = _mm256_max_epi32(max, v);
+
+        __m256i wide_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v));
+        __m256i wide_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1));
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(wide_lo, wide_hi));
+
+        // _mm256_mul_epi32 squares the even elements; shift the odd ones into their place
+        __m256i sq_even = _mm256_mul_epi32(v, v);
+        __m256i v_odd = _mm256_srli_epi64(v, 32);
+        __m256i sq_odd = _mm256_mul_epi32(v_odd, v_odd);
+        sq_lo = _mm256_add_epi64(sq_lo, _mm256_and_si256(sq_even, low_half));
+        sq_lo = _mm256_add_epi64(sq_lo, _mm256_and_si256(sq_odd, low_half));
+        sq_hi = _mm256_add_epi64(sq_hi, _mm256_srli_epi64(sq_even, 32));
+        sq_hi = _mm256_add_epi64(sq_hi, _mm256_srli_epi64(sq_odd, 32));
+    }
+
+    int min_lanes[8], max_lanes[8];
+    long long sum_lanes[4];
+    unsigned long long sq_lo_lanes[4], sq_hi_lanes[4];
+    _mm256_storeu_si256((__m256i*)min_lanes, min);
+    _mm256_storeu_si256((__m256i*)max_lanes, max);
+    _mm256_storeu_si256((__m256i*)sum_lanes, sum);
+    _mm256_storeu_si256((__m256i*)sq_lo_lanes, sq_lo);
+    _mm256_storeu_si256((__m256i*)sq_hi_lanes, sq_hi);
+
+    m->count += i;
+    for (size_t lane = 0; lane < 8; ++lane) {
+        if (min_lanes[lane] < m->min) m->min = min_lanes[lane];
+        if (max_lanes[lane] > m->max) m->max = max_lanes[lane];
+    }
+    moments_add_lanes(m, 4, sum_lanes, sq_lo_lanes, sq_hi_lanes);
+    moments_add_block_scalar(m, x + i, n - i);
+}
+
+__attribute__((target("sse4.1"))) static void moments_add_block_sse41(struct moments* m,
+                                                                      int const* x, size_t n) {
+    __m128i min = _mm_set1_epi32(m->min);
+    __m128i max = _mm_set1_epi32(m->max);
+    __m128i sum = _mm_setzero_si128();
+    __m128i sq_lo = _mm_setzero_si128();
+    __m128i sq_hi = _mm_setzero_si128();
+    __m128i low_half = _mm_set1_epi64x(0xFFFFFFFF);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((__m128i const*)(x + i));
+        min = _mm_min_epi32(min, v);
+        max = _mm_max_epi32(max, v);
+
+        __m128i wide_lo = _mm_cvtepi32_epi64(v);
+        __m128i wide_hi = _mm_cvtepi32_epi64(_mm_srli_si128(v, 8));
+        sum = _mm_add_epi64(sum, _mm_add_epi64(wide_lo, wide_hi));
+
+        __m128i sq_even = _mm_mul_epi32(v, v);
+        __m128i v_odd = _mm_srli_epi64(v, 32);
+        __m128i sq_odd = _mm_mul_epi32(v_odd, v_odd);
+        sq_lo = _mm_add_epi64(sq_lo, _mm_and_si128(sq_even, low_half));
+        sq_lo = _mm_add_epi64(sq_lo, _mm_and_si128(sq_odd, low_half));
+        sq_hi = _mm_add_epi64(sq_hi, _mm_srli_epi64(sq_even, 32));
+        sq_hi = _mm_add_epi64(sq_hi, _mm_srli_epi64(sq_odd, 32));
+    }
+
+    int min_lanes[4], max_lanes[4];
+    long long sum_lanes[2];
+    unsigned long long sq_lo_lanes[2], sq_hi_lanes[2];
+    _mm_storeu_si128((__m128i*)min_lanes, min);
+    _mm_storeu_si128((__m128i*)max_lanes, max);
+    _mm_storeu_si128((__m128i*)sum_lanes, sum);
+    _mm_storeu_si128((__m128i*)sq_lo_lanes, sq_lo);
+    _mm_storeu_si128((__m128i*)sq_hi_lanes, sq_hi);
+
+    m->count += i;
+    for (size_t lane = 0; lane < 4; ++lane) {
+        if (min_lanes[lane] < m->min) m->min = min_lanes[lane];
+        if (max_lanes[lane] > m->max) m->max = max_lanes[lane];
+    }
+    moments_add_lanes(m, 2, sum_lanes, sq_lo_lanes, sq_hi_lanes);
+    moments_add_block_scalar(m, x + i, n - i);
+}
+
+#endif  // HAVE_X86_SIMD
+
+/**
+ * Picks the widest block kernel supported by the running CPU.
+ */
+block_kernel select_block_kernel(void) {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return moments_add_block_avx2;
+    if (__builtin_cpu_supports("sse4.1")) return moments_add_block_sse41;
+#endif
+    return moments_add_block_scalar;
+}
+
+/**
+ * Folds an arbitrary number of values into the moments, block by block.
+ */
+void moments_add_range(struct moments* m, int const* x, size_t n) {
+    static block_kernel kernel = NULL;
+    if (!kernel) kernel = select_block_kernel();
+
+    for (size_t i = 0; i < n; i += REDUCE_BLOCK_SIZE) {
+        size_t block = n - i < REDUCE_BLOCK_SIZE ? n - i : REDUCE_BLOCK_SIZE;
+        kernel(m, x + i, block);
+    }
+}
+
+/**
+ * Upper bound on the number of levels of a KLL sketch;
+ * enough for k * 2^(KLL_MAX_LEVELS - 1) values.
+ */
+#define KLL_MAX_LEVELS 48
+
+/**
+ * Smallest capacity of a KLL sketch level.
+ */
+#define KLL_MIN_CAPACITY 8
+
+/**
+ * KLL quantile sketch (Karnin, Lang & Liberty, 2016).
+ *
+ * Values are kept in a hierarchy of levels, where an item on level h stands for 2^h values.
+ * Once a level outgrows its capacity, it's sorted and every other item (starting at a random
+ * offset) is promoted to the next level. Capacities shrink geometrically (by 2/3) going down
+ * from the top level, so the sketch keeps O(k) items in total, independently of the input size.
+ *
+ * Sketches with the same k can be merged by adding the items of every level of one sketch
+ * into the matching level of the other.
+ */
+struct kll_sketch {
+    unsigned k;
+    unsigned levels;
+    uint64_t n;
+    uint64_t rng;
+    unsigned size[KLL_MAX_LEVELS];
+    double* items[KLL_MAX_LEVELS];  // each has room for 2k items
+};
+
+void kll_init(struct kll_sketch* s, unsigned k, uint64_t seed) {
+    memset(s, 0, sizeof(*s));
+    s->k = k;
+    s->rng = seed * 0x9E3779B97F4A7C15u + 1;
+}
+
+void kll_free(struct kll_sketch* s) {
+    for (unsigned h = 0; h < s->levels; ++h) free(s->items[h]);
+    s->levels = 0;
+}
+
+static void kll_add_level(struct kll_sketch* s) {
+    if (s->levels == KLL_MAX_LEVELS) exit_with_message("hw1-3: quantile sketch overflow");
+    s->items[s->levels] = malloc(2 * s->k * sizeof(double));
+    if (!s->items[s->levels]) exit_with_message("hw1-3: out of memory");
+    s->size[s->levels++] = 0;
+}
+
+/**
+ * Capacity of level h. Level 0 is always given room for k items,
+ * so that fresh values are sorted in large batches.
+ */
+static unsigned kll_capacity(struct kll_sketch const* s, unsigned h) {
+    if (h == 0) return s->k;
+
+    double capacity = s->k;
+    for (unsigned i = h + 1; i < s->levels; ++i) capacity *= 2.0 / 3.0;
+    return capacity < KLL_MIN_CAPACITY ? KLL_MIN_CAPACITY : (unsigned)capacity;
+}
+
+static int compare_doubles(void const* a_ptr, void const* b_ptr) {
+    double a = *(double const*)a_ptr;
+    double b = *(double const*)b_ptr;
+    return (a > b) - (b > a);
+}
+
+/**
+ * Quicksort of doubles, without qsort's indirect calls.
+ */
+static void sort_doubles(double* a, size_t n) {
+    while (n > 16) {
+        // Median of three
+        double x = a[0], y = a[n / 2], z = a[n - 1];
+        double pivot = x < y ? (y < z ? y : (x < z ? z : x)) : (x < z ? x : (y < z ? z : y));
+
+        size_t i = 0, j = n - 1;
+        for (;;) {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i >= j) break;
+            double tmp = a[i];
+            a[i++] = a[j];
+            a[j--] = tmp;
+        }
+
+        // Recurse into the smaller part, loop on the larger one
+        if (j + 1 < n - j - 1) {
+            sort_doubles(a, j + 1);
+            a += j + 1;
+            n -= j + 1;
+        } else {
+            sort_doubles(a + j + 1, n - j - 1);
+            n = j + 1;
+        }
+    }
+
+    for (size_t i = 1; i < n; ++i) {
+        double x = a[i];
+        size_t j = i;
+        for (; j > 0 && a[j - 1] > x; --j) a[j] = a[j - 1];
+        a[j] = x;
+    }
+}
+
+/**
+ * Merges `count` sorted items, taken from `from` with the given stride,
+ * into the sorted level h.
+ */
+static void kll_merge_into_level(struct kll_sketch* s, unsigned h, double const* from,
+                                 size_t count, size_t stride) {
+    double* items = s->items[h];
+    size_t i = s->size[h];
+    size_t j = count;
+    size_t out = i + count;
+
+    while (j > 0) {
+        if (i > 0 && items[i - 1] > from[(j - 1) * stride])
+            items[--out] = items[--i];
+        else
+            items[--out] = from[(--j) * stride];
+    }
+
+    s->size[h] += count;
+}
+
+/**
+ * Halves level h by promoting every other of its sorted items to level h + 1.
+ */
+static void kll_compact(struct kll_sketch* s, unsigned h) {
+    if (h + 1 == s->levels) kll_add_level(s);
+
+    // Levels above 0 are kept sorted
+    double* items = s->items[h];
+    unsigned size = s->size[h];
+    if (h == 0) sort_doubles(items, size);
+
+    // An odd item out stays behind
+    unsigned keep = size & 1;
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 7;
+    s->rng ^= s->rng << 17;
+    unsigned first = keep + (s->rng & 1);
+    kll_merge_into_level(s, h + 1, items + first, (size - first + 1) / 2, 2);
+
+    s->size[h] = keep;
+}
+
+/**
+ * Compacts level h and the levels above it, until none is over capacity.
+ */
+static void kll_compress(struct kll_sketch* s, unsigned h) {
+    for (; h < s->levels && s->size[h] >= kll_capacity(s, h); ++h) kll_compact(s, h);
+}
+
+void kll_add_range(struct kll_sketch* s, int const* x, size_t n) {
+    if (s->levels == 0) kll_add_level(s);
+    s->n += n;
+
+    for (size_t i = 0; i < n; ++i) {
+        s->items[0][s->size[0]++] = x[i];
+        if (s->size[0] >= s->k) kll_compress(s, 0);
+    }
+}
+
+/**
+ * Merges a sketch into another one, level by level.
+ * Both sketches must have been created with the same k.
+ */
+void kll_merge(struct kll_sketch* into, struct kll_sketch const* from) {
+    assert(into->k == from->k);
+    into->n += from->n;
+
+    for (unsigned h = 0; h < from->levels || h < into->levels; ++h) {
+        if (h == into->levels) kll_add_level(into);
+        if (into->size[h] >= kll_capacity(into, h)) kll_compact(into, h);
+
+        if (h < from->levels) {
+            // Level 0 is unsorted, so it's simply appended and sorted on compaction
+            if (h == 0) {
+                for (unsigned i = 0; i < from->size[0]; ++i)
+                    into->items[0][into->size[0]++] = from->items[0][i];
+            } else {
+                kll_merge_into_level(into, h, from->items[h], from->size[h], 1);
+            }
+        }
+
+        if (into->size[h] >= kll_capacity(into, h)) kll_compact(into, h);
+    }
+}
+
+/**
+ * Returns an approximation of the value with rank q * n, for every q in `qs`.
+ * `qs` must be sorted in increasing order.
+ */
+void kll_quantiles(struct kll_sketch const* s, double const* qs, size_t count, double* out) {
+    struct weighted {
+        double value;
+        uint64_t weight;
+    };
+
+    size_t retained = 0;
+    for (unsigned h = 0; h < s->levels; ++h) retained += s->size[h];
+
+    struct weighted* items = malloc((retained + 1) * sizeof(struct weighted));
+    if (!items) exit_with_message("hw1-3: out of memory");
+
+    size_t i = 0;
+    for (unsigned h = 0; h < s->levels; ++h) {
+        for (unsigned j = 0; j < s->size[h]; ++j)
+            items[i++] = (struct weighted){s->items[h][j], (uint64_t)1 << h};
+    }
+    qsort(items, retained, sizeof(struct weighted), compare_doubles);
+
+    uint64_t seen = 0;
+    i = 0;
+    for (size_t q = 0; q < count; ++q) {
+        double rank = qs[q] * (double)s->n;
+        while (i < retained && (i == 0 || (double)seen < rank)) seen += items[i++].weight;
+        out[q] = retained ? items[i - 1].value : 0.0 / 0.0;
+    }
+
+    free(items);
+}
+
+/**
+ * Normalized rank error of the estimates returned by kll_quantiles,
+ * with 99% confidence, fitted like the bounds of the DataSketches KLL implementation
+ * (which also uses c = 2/3 and a minimum level capacity of 8): 1.33% at k = 200.
+ */
+double kll_rank_error(unsigned k) { return 2.65 / k; }
+
+/**
+ * Smallest and largest supported HyperLogLog precisions (log2 of the number of registers).
+ */
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 18
+
+/**
+ * HyperLogLog sketch, estimating the number of distinct values in 2^precision bytes.
+ * Every value is hashed, the top `precision` bits of the hash pick a register,
+ * which keeps the longest run of leading zeros seen among the remaining bits.
+ */
+struct hll_sketch {
+    unsigned precision;
+    uint8_t* registers;
+};
+
+/**
+ * Mixes all bits of the value into a 64-bit hash (the finalizer of MurmurHash3).
+ */
+static inline uint64_t hash_int(int value) {
+    uint64_t h = (uint64_t)(uint32_t)value;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+void hll_init(struct hll_sketch* s, unsigned precision) {
+    s->precision = precision;
+    s->registers = calloc((size_t)1 << precision, 1);
+    if (!s->registers) exit_with_message("hw1-3: out of memory");
+}
+
+void hll_free(struct hll_sketch* s) {
+    free(s->registers);
+    s->registers = NULL;
+}
+
+void hll_add_range(struct hll_sketch* s, int const* x, size_t n) {
+    unsigned p = s->precision;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t h = hash_int(x[i]);
+        uint8_t rank = (uint8_t)(__builtin_clzll((h << p) | ((uint64_t)1 << (p - 1))) + 1);
+        uint8_t* reg = s->registers + (h >> (64 - p));
+        if (rank > *reg) *reg = rank;
+    }
+}
+
+void hll_merge(struct hll_sketch* into, struct hll_sketch const* from) {
+    assert(into->precision == from->precision);
+    size_t m = (size_t)1 << into->precision;
+    for (size_t i = 0; i < m; ++i) {
+        if (from->registers[i] > into->registers[i]) into->registers[i] = from->registers[i];
+    }
+}
+
+/**
+ * Natural logarithm of x >= 1, without calling log(). The only other math.h function in use,
+ * fabsl, is a compiler builtin, so the program still builds without -lm.
+ * x = 2^e * f with f in [1, 2), and ln(f) = 2 atanh((f - 1) / (f + 1)).
+ */
+static double natural_log(double x) {
+    int e = 0;
+    for (; x >= 2.0; ++e) x /= 2.0;
+
+    double t = (x - 1.0) / (x + 1.0);
+    double sum = 0.0, term = t;
+    for (int k = 1; k < 40; k += 2) {
+        sum += term / k;
+        term *= t * t;
+    }
+    return 2.0 * sum + e * 0.69314718055994530942;
+}
+
+/**
+ * Estimates the number of distinct values, with the linear counting correction
+ * for small cardinalities. 64-bit hashes need no correction for large ones.
+ */
+double hll_estimate(struct hll_sketch const* s) {
+    size_t m = (size_t)1 << s->precision;
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < m; ++i) {
+        sum += 1.0 / (double)((uint64_t)1 << s->registers[i]);
+        zeros += s->registers[i] == 0;
+    }
+
+    double alpha = 0.7213 / (1.0 + 1.079 / (double)m);
+    double estimate = alpha * (double)m * (double)m / sum;
+    if (estimate <= 2.5 * (double)m && zeros)
+        estimate = (double)m * natural_log((double)m / (double)zeros);
+    return estimate;
+}
+
+/**
+ * Returns the standard error of HyperLogLog estimates, relative to the true cardinality.
+ */
+double hll_error(unsigned precision) {
+    double root = (double)((size_t)1 << (precision / 2));  // sqrt(2^precision)
+    if (precision % 2) root *= 1.4142135623730951;
+    return 1.04 / root;
+}
+
+/**
+ * A value monitored by the SpaceSaving sketch. Its true frequency lies within
+ * [count - error, count].
+ */
+struct heavy_counter {
+    int value;
+    uint64_t count;
+    uint64_t error;
+};
+
+/**
+ * SpaceSaving sketch of the most frequent values, using k counters. A value without
+ * a counter takes over the one with the smallest count, inheriting that count as its error,
+ * so any frequency is overestimated by at most n / k.
+ *
+ * Counters form a min-heap by count, and an open-addressing hash table
+ * (of at least 2k slots, with linear probing) maps monitored values to their heap positions.
+ */
+struct heavy_sketch {
+    unsigned k;
+    unsigned size;
+    uint64_t n;
+    struct heavy_counter* heap;
+    unsigned* slot_of;  // hash table slot of every counter
+    unsigned* slots;    // heap index + 1, or 0 if empty
+    unsigned mask;
+};
+
+void heavy_init(struct heavy_sketch* s, unsigned k) {
+    unsigned capacity = 1;
+    while (capacity < 2 * k) capacity *= 2;
+
+    s->k = k;
+    s->size = 0;
+    s->n = 0;
+    s->heap = malloc(k * sizeof(struct heavy_counter));
+    s->slot_of = malloc(k * sizeof(unsigned));
+    s->slots = calloc(capacity, sizeof(unsigned));
+    s->mask = capacity - 1;
+    if (!s->heap || !s->slot_of || !s->slots) exit_with_message("hw1-3: out of memory");
+}
+
+void heavy_free(struct heavy_sketch* s) {
+    free(s->heap);
+    free(s->slot_of);
+    free(s->slots);
+    s->heap = NULL;
+    s->slot_of = NULL;
+    s->slots = NULL;
+}
+
+/**
+ * Returns the hash table slot of the value, or of the empty slot where it belongs.
+ */
+static unsigned heavy_find(struct heavy_sketch const* s, int value) {
+    unsigned i = (unsigned)hash_int(value) & s->mask;
+    while (s->slots[i] && s->heap[s->slots[i] - 1].value != value) i = (i + 1) & s->mask;
+    return i;
+}
+
+/**
+ * Removes the counter at heap index `i` from the hash table, shifting back the following
+ * entries of its cluster, so that lookups never need tombstones.
+ */
+static void heavy_forget(struct heavy_sketch* s, unsigned i) {
+    unsigned hole = s->slot_of[i];
+    s->slots[hole] = 0;
+
+    for (unsigned j = (hole + 1) & s->mask; s->slots[j]; j = (j + 1) & s->mask) {
+        unsigned home = (unsigned)hash_int(s->heap[s->slots[j] - 1].value) & s->mask;
+        // Move the entry into the hole, unless its home lies cyclically within (hole, j]
+        if (((j - home) & s->mask) >= ((j - hole) & s->mask)) {
+            s->slots[hole] = s->slots[j];
+            s->slot_of[s->slots[j] - 1] = hole;
+            s->slots[j] = 0;
+            hole = j;
+        }
+    }
+}
+
+/**
+ * Puts the counter `c`, whose hash table slot is `slot`, at heap index `i`.
+ */
+static inline void heavy_place(struct heavy_sketch* s, unsigned i, struct heavy_counter c,
+                               unsigned slot) {
+    s->heap[i] = c;
+    s->slot_of[i] = slot;
+    s->slots[slot] = i + 1;
+}
+
+/**
+ * Restores the heap order after the count of heap[i] increased.
+ */
+static void heavy_sift_down(struct heavy_sketch* s, unsigned i) {
+    struct heavy_counter c = s->heap[i];
+    unsigned slot = s->slot_of[i];
+    for (;;) {
+        unsigned child = 2 * i + 1;
+        if (child >= s->size) break;
+        if (child + 1 < s->size && s->heap[child + 1].count < s->heap[child].count) child++;
+        if (s->heap[child].count >= c.count) break;
+
+        heavy_place(s, i, s->heap[child], s->slot_of[child]);
+        i = child;
+    }
+    heavy_place(s, i, c, slot);
+}
+
+static void heavy_sift_up(struct heavy_sketch* s, unsigned i) {
+    struct heavy_counter c = s->heap[i];
+    unsigned slot = s->slot_of[i];
+    while (i > 0 && s->heap[(i - 1) / 2].count > c.count) {
+        heavy_place(s, i, s->heap[(i - 1) / 2], s->slot_of[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heavy_place(s, i, c, slot);
+}
+
+/**
+ * Removes the counter with the smallest count.
+ */
+static void heavy_pop(struct heavy_sketch* s) {
+    heavy_forget(s, 0);
+    if (--s->size == 0) return;
+    heavy_place(s, 0, s->heap[s->size], s->slot_of[s->size]);
+    heavy_sift_down(s, 0);
+}
+
+/**
+ * Counts `weight` occurrences of the value, with an extra `error` of overestimation.
+ */
+static void heavy_add(struct heavy_sketch* s, int value, uint64_t weight, uint64_t error) {
+    unsigned slot = heavy_find(s, value);
+    if (s->slots[slot]) {
+        unsigned i = s->slots[slot] - 1;
+        s->heap[i].count += weight;
+        s->heap[i].error += error;
+        heavy_sift_down(s, i);
+    } else if (s->size < s->k) {
+        heavy_place(s, s->size, (struct heavy_counter){value, weight, error}, slot);
+        heavy_sift_up(s, s->size++);
+    } else {
+        // Take over the smallest counter
+        uint64_t floor = s->heap[0].count;
+        heavy_pop(s);
+        heavy_add(s, value, floor + weight, floor + error);
+    }
+}
+
+void heavy_add_range(struct heavy_sketch* s, int const* x, size_t n) {
+    for (size_t i = 0; i < n; ++i) heavy_add(s, x[i], 1, 0);
+    s->n += n;
+}
+
+/**
+ * Returns the smallest count among the counters, which bounds the frequency
+ * of any unmonitored value - or 0, if there are still unused counters.
+ */
+static uint64_t heavy_floor(struct heavy_sketch const* s) {
+    return s->size < s->k ? 0 : s->heap[0].count;
+}
+
+/**
+ * Merges two SpaceSaving sketches (Cafaro et al., parallel SpaceSaving): a value missing
+ * from either sketch is assumed to have that sketch's floor count, which is added to both
+ * its count and error, and the k largest of the combined counters are kept.
+ * The merged sketch overestimates by at most (n1 + n2) / k.
+ */
+void heavy_merge(struct heavy_sketch* into, struct heavy_sketch const* from) {
+    assert(into->k == from->k);
+    uint64_t into_floor = heavy_floor(into);
+    uint64_t from_floor = heavy_floor(from);
+
+    // Combine the counters of both sketches in a temporary sketch with room for all of them
+    struct heavy_sketch combined;
+    heavy_init(&combined, into->size + from->size + 1);
+    for (unsigned i = 0; i < into->size; ++i) {
+        struct heavy_counter const* c = into->heap + i;
+        heavy_add(&combined, c->value, c->count, c->error);
+    }
+    for (unsigned i = 0; i < from->size; ++i) {
+        struct heavy_counter const* c = from->heap + i;
+        bool known = combined.slots[heavy_find(&combined, c->value)] != 0;
+        heavy_add(&combined, c->value, c->count + (known ? 0 : into_floor),
+                  c->error + (known ? 0 : into_floor));
+    }
+    for (unsigned i = 0; i < into->size; ++i) {
+        struct heavy_counter const* c = into->heap + i;
+        if (!from->slots[heavy_find(from, c->value)])
+            heavy_add(&combined, c->value, from_floor, from_floor);
+    }
+
+    // Keep the k largest counters
+    while (combined.size > into->k) heavy_pop(&combined);
+
+    // Rebuild the target sketch
+    uint64_t n = into->n + from->n;
+    unsigned k = into->k;
+    heavy_free(into);
+    heavy_init(into, k);
+    for (unsigned i = 0; i < combined.size; ++i) {
+        struct heavy_counter const* c = combined.heap + i;
+        heavy_add(into, c->value, c->count, c->error);
+    }
+    into->n = n;
+    heavy_free(&combined);
+}
+
+static int compare_counters(void const* a_ptr, void const* b_ptr) {
+    struct heavy_counter const* a = a_ptr;
+    struct heavy_counter const* b = b_ptr;
+    return (a->count < b->count) - (b->count < a->count);
+}
+
+/**
+ * Options controlling which sketches are computed alongside the moments.
+ */
+struct summary_options {
+    unsigned quantile_k;     // 0 disables the quantile sketch
+    unsigned hll_precision;  // 0 disables the distinct count sketch
+    unsigned heavy_k;        // 0 disables the heavy hitters sketch
+};
+
+/**
+ * Everything computed in a single pass over the numbers.
+ * Summaries of disjoint parts of the input can be merged into a summary of the whole input.
+ */
+struct summary {
+    struct moments moments;
+    struct kll_sketch* quantiles;  // NULL if not requested
+    struct hll_sketch* distinct;   // NULL if not requested
+    struct heavy_sketch* heavy;    // NULL if not requested
+};
+
+void summary_init(struct summary* s, struct summary_options const* options, uint64_t seed) {
+    moments_init(&s->moments);
+    s->quantiles = NULL;
+    s->distinct = NULL;
+    s->heavy = NULL;
+
+    if (options->quantile_k) {
+        s->quantiles = malloc(sizeof(struct kll_sketch));
+        if (!s->quantiles) exit_with_message("hw1-3: out of memory");
+        kll_init(s->quantiles, options->quantile_k, seed);
+    }
+    if (options->hll_precision) {
+        s->distinct = malloc(sizeof(struct hll_sketch));
+        if (!s->distinct) exit_with_message("hw1-3: out of memory");
+        hll_init(s->distinct, options->hll_precision);
+    }
+    if (options->heavy_k) {
+        s->heavy = malloc(sizeof(struct heavy_sketch));
+        if (!s->heavy) exit_with_message("hw1-3: out of memory");
+        heavy_init(s->heavy, options->heavy_k);
+    }
+}
+
+void summary_free(struct summary* s) {
+    if (s->quantiles) {
+        kll_free(s->quantiles);
+        free(s->quantiles);
+        s->quantiles = NULL;
+    }
+    if (s->distinct) {
+        hll_free(s->distinct);
+        free(s->distinct);
+        s->distinct = NULL;
+    }
+    if (s->heavy) {
+        heavy_free(s->heavy);
+        free(s->heavy);
+        s->heavy = NULL;
+    }
+}
+
+/**
+ * Folds the values into the summary. Every block of values is passed to all sketches
+ * while it's still in cache, so that the input is only streamed from memory once.
+ */
+void summary_add_range(struct summary* s, int const* x, size_t n) {
+    for (size_t i = 0; i < n; i += REDUCE_BLOCK_SIZE) {
+        size_t block = n - i < REDUCE_BLOCK_SIZE ? n - i : REDUCE_BLOCK_SIZE;
+        moments_add_range(&s->moments, x + i, block);
+        if (s->quantiles) kll_add_range(s->quantiles, x + i, block);
+        if (s->distinct) hll_add_range(s->distinct, x + i, block);
+        if (s->heavy) heavy_add_range(s->heavy, x + i, block);
+    }
+}
+
+void summary_merge(struct summary* into, struct summary const* from) {
+    moments_merge(&into->moments, &from->moments);
+    if (into->quantiles) kll_merge(into->quantiles, from->quantiles);
+    if (into->distinct) hll_merge(into->distinct, from->distinct);
+    if (into->heavy) heavy_merge(into->heavy, from->heavy);
+}
+
+/**
+ * A contiguous slice of the numbers reduced by a single thread.
+ */
+struct reduce_task {
+    pthread_t thread;
+    int const* nums;
+    size_t count;
+    struct summary result;
+};
+
+static void* reduce_worker(void* arg) {
+    struct reduce_task* task = arg;
+    summary_add_range(&task->result, task->nums, task->count);
+    return NULL;
+}
+
+/**
+ * Computes the summary of an array by splitting it across `threads` workers,
+ * each making a single fused pass over its slice, and merging their partial summaries.
+ */
+void reduce_numbers(int const* nums, size_t count, unsigned threads,
+                    struct summary_options const* options, struct summary* out) {
+    // Don't spawn threads for slices smaller than a block
+    if (threads > count / REDUCE_BLOCK_SIZE) threads = count / REDUCE_BLOCK_SIZE;
+    if (threads == 0) threads = 1;
+
+    // Make sure the kernel is picked before the workers race to do so
+    summary_init(out, options, 0);
+    moments_add_range(&out->moments, nums, 0);
+
+    struct reduce_task* tasks = calloc(threads, sizeof(struct reduce_task));
+    if (!tasks) exit_with_message("hw1-3: out of memory");
+
+    size_t per_thread = count / threads;
+    for (unsigned t = 0; t < threads; ++t) {
+        tasks[t].nums = nums + t * per_thread;
+        tasks[t].count = t == threads - 1 ? count - t * per_thread : per_thread;
+        summary_init(&tasks[t].result, options, t + 1);
+        if (t == 0) continue;  // the main thread handles slice 0 itself
+
+        int err = pthread_create(&tasks[t].thread, NULL, reduce_worker, tasks + t);
+        if (err) exit_with_message("hw1-3: pthread_create: %s", strerror(err));
+    }
+
+    reduce_worker(tasks);
+    for (unsigned t = 0; t < threads; ++t) {
+        if (t > 0) pthread_join(tasks[t].thread, NULL);
+        summary_merge(out, &tasks[t].result);
+        summary_free(&tasks[t].result);
+    }
+
+    free(tasks);
+}
+
+/**
+ * Returns the number of online CPUs, used as the default number of worker threads.
+ */
+unsigned default_thread_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (unsigned)cpus : 1;
+}
+
+/**
+ * Size of a single read(2) when streaming numbers.
+ */
+#define STREAM_CHUNK_SIZE (1 << 20)
+
+/**
+ * Reads whitespace-separated integers from a file descriptor,
+ * chunk by chunk, using a fixed amount of memory.
+ */
+struct number_stream {
+    int fd;
+    char* buffer;   // STREAM_CHUNK_SIZE bytes
+    size_t length;  // bytes currently held in the buffer
+    size_t pos;     // bytes of the buffer already parsed
+    size_t offset;  // input offset of the start of the buffer
+    bool eof;
+};
+
+static inline bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+/**
+ * Moves the unparsed tail of the buffer to its front and fills the rest with new data.
+ * Returns false if no new data could be read.
+ */
+bool number_stream_refill(struct number_stream* s) {
+    if (s->eof) return false;
+
+    size_t tail = s->length - s->pos;
+    if (tail == STREAM_CHUNK_SIZE)
+        exit_with_message("hw1-3: token too long at byte %zu", s->offset + s->pos);
+    memmove(s->buffer, s->buffer + s->pos, tail);
+    s->offset += s->pos;
+    s->length = tail;
+    s->pos = 0;
+
+    ssize_t got;
+    do {
+        got = read(s->fd, s->buffer + s->length, STREAM_CHUNK_SIZE - s->length);
+    } while (got < 0 && errno == EINTR);
+
+    if (got < 0) {
+        perror("read");
+        exit(1);
+    } else if (got == 0) {
+        s->eof = true;
+        return false;
+    }
+
+    s->length += (size_t)got;
+    return true;
+}
+
+/**
+ * Reads the next whitespace-separated token from the stream.
+ * Returns the token length (0 on end of input); the token starts at s->buffer + *start.
+ * A token is only returned once its terminating whitespace (or EOF) has been seen.
+ */
+size_t number_stream_next_token(struct number_stream* s, size_t* start) {
+    for (;;) {
+        while (s->pos < s->length && is_space(s->buffer[s->pos])) s->pos++;
+
+        size_t end = s->pos;
+        while (end < s->length && !is_space(s->buffer[end])) end++;
+
+        if (end < s->length || (s->eof && end > s->pos)) {
+            *start = s->pos;
+            s->pos = end;
+            return end - *start;
+        }
+
+        if (!number_stream_refill(s) && s->pos == s->length) return 0;
+    }
+}
+
+/**
+ * Returns the longest unparsed part of the buffer which ends on a token boundary,
+ * as [*start, *end). Returns false on end of input.
+ */
+bool number_stream_next_chunk(struct number_stream* s, size_t* start, size_t* end) {
+    for (;;) {
+        size_t boundary = s->length;
+        if (!s->eof) {
+            while (boundary > s->pos && !is_space(s->buffer[boundary - 1])) boundary--;
+        }
+
+        if (boundary > s->pos) {
+            *start = s->pos;
+            *end = boundary;
+            s->pos = boundary;
+            return true;
+        }
+
+        if (!number_stream_refill(s) && s->pos == s->length) return false;
+    }
+}
+
+/**
+ * Converts a token to an integer in the range [lo, hi], exiting on malformed input.
+ * `offset` is the position of the token in the input, used in error messages.
+ */
+long long parse_token(char const* token, size_t length, long long lo, long long hi,
+                      size_t offset) {
+    size_t i = 0;
+    bool negative = token[0] == '-';
+    if (token[0] == '-' || token[0] == '+') i++;
+    if (i == length)
+        exit_with_message("hw1-3: malformed number \"%.*s\" at byte %zu", (int)length, token,
+                          offset);
+
+    unsigned long long limit = negative ? -(unsigned long long)lo : (unsigned long long)hi;
+    unsigned long long value = 0;
+    for (; i < length; ++i) {
+        unsigned digit = (unsigned char)token[i] - '0';
+        if (digit > 9)
+            exit_with_message("hw1-3: malformed number \"%.*s\" at byte %zu", (int)length,
+                              token, offset);
+        if (value > (limit - digit) / 10)
+            exit_with_message("hw1-3: number out of range \"%.*s\" at byte %zu", (int)length,
+                              token, offset);
+        value = value * 10 + digit;
+    }
+
+    return negative && value ? -(long long)(value - 1) - 1 : (long long)value;
+}
+
+/**
+ * A tokenizer parses up to `capacity` whitespace-separated ints from [*p, end) into `out`,
+ * advancing *p past the last parsed token and returning the number of parsed values.
+ * `origin` is the address of the input's first byte, used to report byte offsets.
+ *
+ * Every tokenizer is written once, taking a `wide` flag to store long longs instead of ints,
+ * and then specialized for both by inlining.
+ */
+typedef size_t (*tokenizer)(char const** p, char const* end, char const* origin, int* out,
+                            size_t capacity);
+typedef size_t (*wide_tokenizer)(char const** p, char const* end, char const* origin,
+                                 long long* out, size_t capacity);
+
+#define TOKENIZER_INLINE static inline __attribute__((always_inline))
+
+TOKENIZER_INLINE void store_number(void* out, size_t n, long long value, bool wide) {
+    if (wide)
+        ((long long*)out)[n] = value;
+    else
+        ((int*)out)[n] = (int)value;
+}
+
+/**
+ * Parses values into out[n, capacity), returning the new number of values in `out`.
+ */
+TOKENIZER_INLINE size_t tokenize_scalar(char const** p, char const* end, char const* origin,
+                                        void* out, size_t n, size_t capacity, bool wide) {
+    char const* q = *p;
+
+    while (n < capacity) {
+        while (q < end && is_space(*q)) q++;
+        if (q == end) break;
+
+        char const* token = q;
+        while (q < end && !is_space(*q)) q++;
+        store_number(out, n++,
+                     parse_token(token, q - token, wide ? LLONG_MIN : INT_MIN,
+                                 wide ? LLONG_MAX : INT_MAX, token - origin),
+                     wide);
+    }
+
+    *p = q;
+    return n;
+}
+
+static size_t parse_numbers_scalar(char const** p, char const* end, char const* origin,
+                                   int* out, size_t capacity) {
+    return tokenize_scalar(p, end, origin, out, 0, capacity, false);
+}
+
+static size_t parse_wide_numbers_scalar(char const** p, char const* end, char const* origin,
+                                        long long* out, size_t capacity) {
+    return tokenize_scalar(p, end, origin, out, 0, capacity, true);
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * Vectorized tokenizer: classifies 16 bytes at a time to skip whitespace
+ * and measure each token, then converts up to 10 digits at once with
+ * multiply-add instructions. Tokens it can't handle (near the end of the input,
+ * long, out of range or malformed tokens) go through the scalar path.
+ */
+__attribute__((target("sse4.1"))) TOKENIZER_INLINE size_t tokenize_sse41(char const** p,
+                                                                          char const* end,
+                                                                          char const* origin,
+                                                                          void* out,
+                                                                          size_t capacity,
+                                                                          bool wide) {
+    __m128i const zero = _mm_set1_epi8('0');
+    __m128i const nine = _mm_set1_epi8(9);
+    __m128i const space = _mm_set1_epi8(' ');
+    __m128i const tab = _mm_set1_epi8('\t');
+    __m128i const four = _mm_set1_epi8('\r' - '\t');
+    __m128i const positions = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    char const* q = *p;
+    size_t n = 0;
+
+    while (n < capacity && end - q >= 16) {
+        // Skip whitespace
+        __m128i chunk = _mm_loadu_si128((__m128i const*)q);
+        __m128i ctrl = _mm_sub_epi8(chunk, tab);
+        __m128i is_ws = _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                                     _mm_cmpeq_epi8(_mm_min_epu8(ctrl, four), ctrl));
+        unsigned ws = (unsigned)_mm_movemask_epi8(is_ws);
+        if (ws == 0xFFFF) {
+            q += 16;
+            continue;
+        } else if (ws & 1) {
+            q += __builtin_ctz(~ws);
+            continue;
+        }
+
+        // Step over the sign
+        char const* token = q;
+        bool negative = *q == '-';
+        if (*q == '-' || *q == '+') {
+            if (end - ++q < 16) {
+                q = token;
+                break;
+            }
+            chunk = _mm_loadu_si128((__m128i const*)q);
+            ctrl = _mm_sub_epi8(chunk, tab);
+            is_ws = _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                                 _mm_cmpeq_epi8(_mm_min_epu8(ctrl, four), ctrl));
+            ws = (unsigned)_mm_movemask_epi8(is_ws);
+        }
+
+        // Measure the run of leading digits, and make sure it's followed by whitespace
+        __m128i digits = _mm_sub_epi8(chunk, zero);
+        unsigned is_digit =
+            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(digits, nine), digits));
+        unsigned length = __builtin_ctz(~is_digit);
+        if (length == 0 || length > 10 || !((ws >> length) & 1)) {
+            q = token;
+            n = tokenize_scalar(&q, end, origin, out, n, n + 1, wide);
+            continue;
+        }
+
+        // Right-align the digits in the register, zeroing everything in front of them
+        __m128i shift = _mm_add_epi8(positions, _mm_set1_epi8((char)(length - 16)));
+        digits = _mm_shuffle_epi8(digits, shift);
+
+        // Combine pairs of digits, then pairs of pairs, and so on
+        __m128i pairs = _mm_maddubs_epi16(digits, _mm_set1_epi16(0x010A));
+        __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00010064));
+        quads = _mm_packus_epi32(quads, quads);
+        __m128i octets = _mm_madd_epi16(quads, _mm_set1_epi32(0x00012710));
+        unsigned long long value = (unsigned long long)(unsigned)_mm_extract_epi32(octets, 2) *
+                                       100000000u +
+                                   (unsigned)_mm_extract_epi32(octets, 3);
+
+        // Up to 10 digits always fit a long long
+        if (!wide && value > (negative ? -(unsigned long long)INT_MIN : INT_MAX)) {
+            q = token;
+            n = tokenize_scalar(&q, end, origin, out, n, n + 1, wide);
+            continue;
+        }
+
+        store_number(out, n++, negative ? -(long long)value : (long long)value, wide);
+        q += length;
+    }
+
+    *p = q;
+    return tokenize_scalar(p, end, origin, out, n, capacity, wide);
+}
+
+__attribute__((target("sse4.1"))) static size_t parse_numbers_sse41(char const** p,
+                                                                    char const* end,
+                                                                    char const* origin,
+                                                                    int* out,
+                                                                    size_t capacity) {
+    return tokenize_sse41(p, end, origin, out, capacity, false);
+}
+
+__attribute__((target("sse4.1"))) static size_t parse_wide_numbers_sse41(char const** p,
+                                                                         char const* end,
+                                                                         char const* origin,
+                                                                         long long* out,
+                                                                         size_t capacity) {
+    return tokenize_sse41(p, end, origin, out, capacity, true);
+}
+
+#endif  // HAVE_X86_SIMD
+
+/**
+ * Parses whitespace-separated integers with the fastest tokenizer supported by the CPU.
+ */
+size_t parse_numbers(char const** p, char const* end, char const* origin, int* out,
+                     size_t capacity) {
+    static tokenizer impl = NULL;
+    if (!impl) {
+        impl = parse_numbers_scalar;
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1")) impl = parse_numbers_sse41;
+#endif
+    }
+    return impl(p, end, origin, out, capacity);
+}
+
+/**
+ * Like parse_numbers, but accepts any long long.
+ */
+size_t parse_wide_numbers(char const** p, char const* end, char const* origin, long long* out,
+                          size_t capacity) {
+    static wide_tokenizer impl = NULL;
+    if (!impl) {
+        impl = parse_wide_numbers_scalar;
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1")) impl = parse_wide_numbers_sse41;
+#endif
+    }
+    return impl(p, end, origin, out, capacity);
+}
+
+/**
+ * Parses the whitespace-separated ints in [p, end) and folds them into the summary,
+ * going through `values` (with room for REDUCE_BLOCK_SIZE ints) one cache-sized piece at a time.
+ */
+void summarize_text(struct summary* s, char const* p, char const* end, char const* origin,
+                    int* values) {
+    while (p < end) {
+        size_t n = parse_numbers(&p, end, origin, values, REDUCE_BLOCK_SIZE);
+        summary_add_range(s, values, n);
+    }
+}
+
+/**
+ * Computes the statistics of a count-prefixed list of numbers read from `fd`,
+ * without ever storing all of the numbers.
+ */
+void stream_statistics(int fd, struct summary_options const* options, struct summary* out) {
+    struct number_stream s = {.fd = fd, .buffer = malloc(STREAM_CHUNK_SIZE)};
+    int* values = malloc(REDUCE_BLOCK_SIZE * sizeof(int));
+    if (!s.buffer || !values) exit_with_message("hw1-3: out of memory");
+
+    // Read the number of numbers
+    size_t start, end;
+    size_t length = number_stream_next_token(&s, &start);
+    if (length == 0) exit_with_message("hw1-3: missing number count");
+    size_t declared_count =
+        (size_t)parse_token(s.buffer + start, length, 0, LLONG_MAX, s.offset + start);
+
+    // Parse the input chunk by chunk, folding every chunk into the running statistics
+    summary_init(out, options, 0);
+    while (number_stream_next_chunk(&s, &start, &end))
+        summarize_text(out, s.buffer + start, s.buffer + end, s.buffer - s.offset, values);
+
+    if (out->moments.count != declared_count)
+        fprintf(stderr, "hw1-3: expected %zu numbers, got %zu\n", declared_count,
+                out->moments.count);
+
+    free(values);
+    free(s.buffer);
+}
+
+/**
+ * Size of the buffers passed from the reader to the parsers in pipelined mode.
+ */
+#define PIPELINE_CHUNK_SIZE (8 << 20)
+
+/**
+ * A buffer of text, which always ends on a token boundary.
+ */
+struct text_chunk {
+    char* data;     // PIPELINE_CHUNK_SIZE bytes, page-aligned
+    size_t length;  // bytes of text in data
+    size_t offset;  // input offset of data[0]
+};
+
+/**
+ * A blocking FIFO of chunk pointers. As there's a fixed number of chunks,
+ * the queue is sized to hold all of them, and pushing never blocks.
+ */
+struct chunk_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    struct text_chunk** items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+};
+
+void chunk_queue_init(struct chunk_queue* q, size_t capacity) {
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    q->items = malloc(capacity * sizeof(struct text_chunk*));
+    if (!q->items) exit_with_message("hw1-3: out of memory");
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+}
+
+void chunk_queue_free(struct chunk_queue* q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    free(q->items);
+}
+
+void chunk_queue_push(struct chunk_queue* q, struct text_chunk* c) {
+    pthread_mutex_lock(&q->lock);
+    assert(q->count < q->capacity);
+    q->items[(q->head + q->count++) % q->capacity] = c;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+struct text_chunk* chunk_queue_pop(struct chunk_queue* q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) pthread_cond_wait(&q->not_empty, &q->lock);
+    struct text_chunk* c = q->items[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    pthread_mutex_unlock(&q->lock);
+    return c;
+}
+
+/**
+ * State shared by the reader and the parser threads.
+ * Chunks cycle from `empty` (owned by the reader) to `full` (owned by the parsers) and back.
+ * A NULL chunk on the `full` queue tells a parser to stop.
+ */
+struct pipeline {
+    struct chunk_queue empty;
+    struct chunk_queue full;
+};
+
+struct parse_task {
+    pthread_t thread;
+    struct pipeline* pipeline;
+    struct summary result;
+};
+
+static void* parse_worker(void* arg) {
+    struct parse_task* task = arg;
+    int* values = malloc(REDUCE_BLOCK_SIZE * sizeof(int));
+    if (!values) exit_with_message("hw1-3: out of memory");
+
+    struct text_chunk* c;
+    while ((c = chunk_queue_pop(&task->pipeline->full))) {
+        summarize_text(&task->result, c->data, c->data + c->length, c->data - c->offset,
+                       values);
+        chunk_queue_push(&task->pipeline->empty, c);
+    }
+
+    free(values);
+    return NULL;
+}
+
+/**
+ * Fills the chunk from fd, after the `carry` bytes already at its start.
+ * Returns false on EOF.
+ */
+static bool fill_chunk(int fd, struct text_chunk* c) {
+    while (c->length < PIPELINE_CHUNK_SIZE) {
+        ssize_t got = read(fd, c->data + c->length, PIPELINE_CHUNK_SIZE - c->length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            perror("read");
+            exit(1);
+        }
+        if (got == 0) return false;
+        c->length += (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * Like stream_statistics, but overlaps I/O with parsing: the calling thread reads the input
+ * into large buffers, split on whitespace, while `threads` parser threads tokenize and
+ * reduce them into partial summaries, which are merged at the end.
+ */
+void pipeline_statistics(int fd, unsigned threads, struct summary_options const* options,
+                         struct summary* out) {
+    // Read the number of numbers, just like stream_statistics does
+    struct number_stream s = {.fd = fd, .buffer = malloc(STREAM_CHUNK_SIZE)};
+    if (!s.buffer) exit_with_message("hw1-3: out of memory");
+
+    size_t start;
+    size_t length = number_stream_next_token(&s, &start);
+    if (length == 0) exit_with_message("hw1-3: missing number count");
+    size_t declared_count =
+        (size_t)parse_token(s.buffer + start, length, 0, LLONG_MAX, s.offset + start);
+
+    // Allocate the chunks - enough for every parser to have one, with the reader
+    // filling the next ones in the meantime
+    size_t chunk_count = 2 * (size_t)threads + 2;
+    struct pipeline p;
+    chunk_queue_init(&p.empty, chunk_count);
+    chunk_queue_init(&p.full, chunk_count + threads);
+
+    struct text_chunk* chunks = calloc(chunk_count, sizeof(struct text_chunk));
+    if (!chunks) exit_with_message("hw1-3: out of memory");
+    for (size_t i = 0; i < chunk_count; ++i) {
+        if (posix_memalign((void**)&chunks[i].data, 4096, PIPELINE_CHUNK_SIZE))
+            exit_with_message("hw1-3: out of memory");
+        chunk_queue_push(&p.empty, chunks + i);
+    }
+
+    // Start the parsers
+    struct parse_task* tasks = calloc(threads, sizeof(struct parse_task));
+    if (!tasks) exit_with_message("hw1-3: out of memory");
+    for (unsigned t = 0; t < threads; ++t) {
+        tasks[t].pipeline = &p;
+        summary_init(&tasks[t].result, options, t + 1);
+        int err = pthread_create(&tasks[t].thread, NULL, parse_worker, tasks + t);
+        if (err) exit_with_message("hw1-3: pthread_create: %s", strerror(err));
+    }
+
+    // Whatever the header reader buffered past the count starts the first chunk
+    char const* carry = s.buffer + s.pos;
+    size_t carry_length = s.length - s.pos;
+    size_t offset = s.offset + s.pos;
+    bool more = !s.eof;
+
+    for (;;) {
+        struct text_chunk* c = chunk_queue_pop(&p.empty);
+        memmove(c->data, carry, carry_length);
+        c->length = carry_length;
+        c->offset = offset;
+        if (more) more = fill_chunk(fd, c);
+
+        // Cut the chunk after its last whitespace, carrying the partial token over
+        size_t boundary = c->length;
+        if (more) {
+            while (boundary > 0 && !is_space(c->data[boundary - 1])) boundary--;
+            if (boundary == 0) exit_with_message("hw1-3: token too long at byte %zu", offset);
+        }
+
+        carry = c->data + boundary;
+        carry_length = c->length - boundary;
+        offset += boundary;
+        c->length = boundary;
+        chunk_queue_push(&p.full, c);
+
+        if (!more) break;
+    }
+
+    // Stop the parsers and merge their results
+    summary_init(out, options, 0);
+    for (unsigned t = 0; t < threads; ++t) chunk_queue_push(&p.full, NULL);
+    for (unsigned t = 0; t < threads; ++t) {
+        pthread_join(tasks[t].thread, NULL);
+        summary_merge(out, &tasks[t].result);
+        summary_free(&tasks[t].result);
+    }
+
+    if (out->moments.count != declared_count)
+        fprintf(stderr, "hw1-3: expected %zu numbers, got %zu\n", declared_count,
+                out->moments.count);
+
+    for (size_t i = 0; i < chunk_count; ++i) free(chunks[i].data);
+    free(chunks);
+    free(tasks);
+    chunk_queue_free(&p.empty);
+    chunk_queue_free(&p.full);
+    free(s.buffer);
+}
+
+/**
+ * A read-only memory mapping of a whole file.
+ */
+struct mapped_file {
+    char const* data;
+    size_t size;
+};
+
+/**
+ * Maps the whole file into memory, exiting on failure. Empty files are left unmapped.
+ */
+void map_file(char const* filename, struct mapped_file* out) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        exit(1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        exit(1);
+    }
+
+    out->data = NULL;
+    out->size = (size_t)st.st_size;
+    if (out->size > 0) {
+        void* data = mmap(NULL, out->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        madvise(data, out->size, MADV_SEQUENTIAL);
+        out->data = data;
+    }
+
+    close(fd);
+}
+
+void unmap_file(struct mapped_file* f) {
+    if (f->data) munmap((void*)f->data, f->size);
+    f->data = NULL;
+    f->size = 0;
+}
+
+/**
+ * Binary number files start with this header, followed by `count` raw little-endian values,
+ * so that they can be mapped and used without any parsing or copying.
+ *
+ * If `flags & NUMFILE_HAS_STATS`, min, max and the 128-bit sum of all (integer) values
+ * are precomputed. Plain statistics check them against the values, to detect corrupted files,
+ * and the modes which need ints use the range to reject files which don't fit without a scan.
+ */
+struct numfile_header {
+    char magic[8];
+    uint32_t type;
+    uint32_t flags;
+    uint64_t count;
+    int64_t min;
+    int64_t max;
+    uint64_t sum_lo;
+    int64_t sum_hi;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(struct numfile_header) == 64, "number file header must be 64 bytes");
+
+#define NUMFILE_MAGIC "KNU\x01NUMS"
+#define NUMFILE_INT32 1
+#define NUMFILE_INT16 2
+#define NUMFILE_INT64 3
+#define NUMFILE_FLOAT32 4
+#define NUMFILE_FLOAT64 5
+#define NUMFILE_HAS_STATS 1
+
+/**
+ * Returns the size of a single value of a number file element type, or 0 if it's unknown.
+ */
+size_t numfile_type_size(uint32_t type) {
+    switch (type) {
+        case NUMFILE_INT16:
+            return sizeof(int16_t);
+        case NUMFILE_INT32:
+            return sizeof(int32_t);
+        case NUMFILE_INT64:
+            return sizeof(int64_t);
+        case NUMFILE_FLOAT32:
+            return sizeof(float);
+        case NUMFILE_FLOAT64:
+            return sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+char const* numfile_type_name(uint32_t type) {
+    static char const* const names[] = {"unknown", "int32",   "int16",
+                                        "int64",   "float32", "float64"};
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : names[0];
+}
+
+bool is_numfile(struct mapped_file const* f) {
+    return f->size >= sizeof(struct numfile_header) &&
+           memcmp(f->data, NUMFILE_MAGIC, sizeof(((struct numfile_header*)0)->magic)) == 0;
+}
+
+/**
+ * Validates a mapped binary number file and returns a pointer to its values,
+ * of the element type returned in *out_type.
+ */
+void const* numfile_typed_values(struct mapped_file const* f, char const* filename,
+                                 uint32_t* out_type, size_t* out_count) {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    exit_with_message("hw1-3: %s: binary number files require a little-endian host", filename);
+#endif
+
+    struct numfile_header const* header = (struct numfile_header const*)f->data;
+    size_t size = numfile_type_size(header->type);
+    if (!size) exit_with_message("hw1-3: %s: unsupported element type %u", filename, header->type);
+    if (header->count > (f->size - sizeof(struct numfile_header)) / size)
+        exit_with_message("hw1-3: %s: truncated, expected %llu numbers", filename,
+                          (unsigned long long)header->count);
+
+    *out_type = header->type;
+    *out_count = header->count;
+    return f->data + sizeof(struct numfile_header);
+}
+
+/**
+ * Like numfile_typed_values, but for the modes which only support ints. Values of the other
+ * types are widened or narrowed into a new array, in which case *out_copied is set.
+ * Exits unless every value is an integer fitting an int.
+ */
+int* numfile_values(struct mapped_file const* f, char const* filename, size_t* out_count,
+                    bool* out_copied) {
+    uint32_t type;
+    void const* values = numfile_typed_values(f, filename, &type, out_count);
+    *out_copied = type != NUMFILE_INT32;
+    if (!*out_copied) return (int*)values;
+
+    // The precomputed range rejects integer files without looking at their values
+    struct numfile_header const* header = (struct numfile_header const*)f->data;
+    if ((header->flags & NUMFILE_HAS_STATS) && *out_count &&
+        (header->min < INT_MIN || header->max > INT_MAX))
+        exit_with_message("hw1-3: %s: this mode needs numbers fitting an int, got %lld..%lld",
+                          filename, (long long)header->min, (long long)header->max);
+
+    size_t count = *out_count;
+    int* nums = malloc(count * sizeof(int));
+    if (!nums && count) exit_with_message("hw1-3: out of memory");
+
+    for (size_t i = 0; i < count; i++) {
+        double v;
+        switch (type) {
+            case NUMFILE_INT16:
+                nums[i] = ((int16_t const*)values)[i];
+                continue;
+            case NUMFILE_INT64: {
+                int64_t n = ((int64_t const*)values)[i];
+                if (n < INT_MIN || n > INT_MAX)
+                    exit_with_message("hw1-3: %s: this mode needs numbers fitting an int, "
+                                      "got %lld",
+                                      filename, (long long)n);
+                nums[i] = (int)n;
+                continue;
+            }
+            case NUMFILE_FLOAT32:
+                v = ((float const*)values)[i];
+                break;
+            default:
+                v = ((double const*)values)[i];
+                break;
+        }
+        // Written so that NaN fails too
+        if (!(v >= INT_MIN && v <= INT_MAX) || v != (int)v)
+            exit_with_message("hw1-3: %s: this mode needs integers fitting an int, got %.17g",
+                              filename, v);
+        nums[i] = (int)v;
+    }
+    return nums;
+}
+
+/**
+ * Number of values in every block of a packed file.
+ * Blocks are decoded independently, into a buffer which stays in L1/L2 cache.
+ */
+#define PACKED_BLOCK_SIZE 4096
+
+/**
+ * Zero bytes after the packed data, so that the SIMD decoder may always load 16 bytes.
+ */
+#define PACKED_PADDING 16
+
+/**
+ * Packed files hold ints compressed with delta + zigzag + Stream-VByte coding:
+ * every value is stored as the zigzag-encoded difference from the previous one
+ * (restarting from 0 at every block), in 1 to 4 bytes.
+ * The lengths of 4 consecutive values are kept together in a separate control byte,
+ * so that a group of 4 is decoded with a single shuffle.
+ *
+ * The header is followed by `blocks + 1` offsets of the blocks, relative to the start of
+ * the data, and then the data itself: for every block, the control bytes of its groups
+ * of 4 values (the last one padded with zeros), followed by the value bytes.
+ */
+struct packed_header {
+    char magic[8];
+    uint64_t count;
+    uint64_t block_size;
+    uint64_t blocks;
+    uint64_t data_size;
+    uint64_t reserved[3];
+};
+
+static_assert(sizeof(struct packed_header) == 64, "packed file header must be 64 bytes");
+
+#define PACKED_MAGIC "KNU\x01SVB1"
+
+/**
+ * A validated, mapped packed file.
+ */
+struct packed_file {
+    struct packed_header const* header;
+    uint64_t const* offsets;
+    uint8_t const* data;
+};
+
+bool is_packed_file(struct mapped_file const* f) {
+    return f->size >= sizeof(struct packed_header) &&
+           memcmp(f->data, PACKED_MAGIC, sizeof(((struct packed_header*)0)->magic)) == 0;
+}
+
+/**
+ * Validates the layout of a mapped packed file. Blocks are validated as they're decoded.
+ */
+void open_packed_file(struct mapped_file const* f, char const* filename,
+                      struct packed_file* out) {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    exit_with_message("hw1-3: %s: packed files require a little-endian host", filename);
+#endif
+
+    struct packed_header const* h = (struct packed_header const*)f->data;
+    size_t available = f->size - sizeof(struct packed_header);
+    if (h->block_size != PACKED_BLOCK_SIZE || h->blocks >= available / sizeof(uint64_t) ||
+        h->blocks != (h->count + PACKED_BLOCK_SIZE - 1) / PACKED_BLOCK_SIZE)
+        exit_with_message("hw1-3: %s: corrupted packed file header", filename);
+
+    available -= (h->blocks + 1) * sizeof(uint64_t);
+    if (available < PACKED_PADDING || h->data_size > available - PACKED_PADDING)
+        exit_with_message("hw1-3: %s: truncated packed file", filename);
+
+    out->header = h;
+    out->offsets = (uint64_t const*)(f->data + sizeof(struct packed_header));
+    out->data = (uint8_t const*)(out->offsets + h->blocks + 1);
+}
+
+static inline uint32_t zigzag_encode(uint32_t delta) {
+    return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static inline uint32_t zigzag_decode(uint32_t value) { return (value >> 1) ^ -(value & 1); }
+
+/**
+ * Encodes a block of at most PACKED_BLOCK_SIZE values into `out`,
+ * which must have room for 17 bytes per group of 4. Returns the number of bytes written.
+ */
+size_t packed_encode_block(int const* x, size_t n, uint8_t* out) {
+    size_t groups = (n + 3) / 4;
+    uint8_t* control = out;
+    uint8_t* p = out + groups;
+    uint32_t previous = 0;
+
+    for (size_t g = 0; g < groups; ++g) {
+        uint8_t key = 0;
+        for (size_t j = 0; j < 4; ++j) {
+            size_t i = 4 * g + j;
+            uint32_t value = 0;
+            if (i < n) {
+                value = zigzag_encode((uint32_t)x[i] - previous);
+                previous = (uint32_t)x[i];
+            }
+
+            unsigned length =
+                1 + (value >= (1u << 8)) + (value >= (1u << 16)) + (value >= (1u << 24));
+            for (unsigned b = 0; b < length; ++b) *p++ = (uint8_t)(value >> (8 * b));
+            key |= (uint8_t)((length - 1) << (2 * j));
+        }
+        control[g] = key;
+    }
+
+    return p - out;
+}
+
+/**
+ * Number of value bytes of a group of 4, for every control byte.
+ */
+static uint8_t packed_lengths[256];
+
+/**
+ * Shuffles moving the value bytes of a group of 4 into their 32-bit lanes,
+ * for every control byte (-1 clears the byte).
+ */
+static uint8_t packed_shuffles[256][16];
+
+static void packed_init_tables(void) {
+    for (unsigned key = 0; key < 256; ++key) {
+        uint8_t position = 0;
+        for (unsigned j = 0; j < 4; ++j) {
+            unsigned length = ((key >> (2 * j)) & 3) + 1;
+            for (unsigned b = 0; b < 4; ++b)
+                packed_shuffles[key][4 * j + b] = b < length ? position + b : 0xFF;
+            position += length;
+        }
+        packed_lengths[key] = position;
+    }
+}
+
+/**
+ * Decodes the groups of 4 values of a block into `out`, which must have room
+ * for a multiple of 4 values. Returns a pointer past the consumed value bytes.
+ */
+typedef uint8_t const* (*block_decoder)(uint8_t const* block, size_t groups, int* out);
+
+static uint8_t const* packed_decode_block_scalar(uint8_t const* block, size_t groups,
+                                                 int* out) {
+    uint8_t const* p = block + groups;
+    uint32_t previous = 0;
+
+    for (size_t g = 0; g < groups; ++g) {
+        uint8_t key = block[g];
+        for (unsigned j = 0; j < 4; ++j) {
+            unsigned length = ((key >> (2 * j)) & 3) + 1;
+            uint32_t value = 0;
+            for (unsigned b = 0; b < length; ++b) value |= (uint32_t)p[b] << (8 * b);
+            p += length;
+
+            previous += zigzag_decode(value);
+            out[4 * g + j] = (int)previous;
+        }
+    }
+
+    return p;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * Decodes a group of 4 values with a single pshufb, then undoes the zigzag
+ * and the delta coding with a prefix sum over the lanes.
+ */
+__attribute__((target("ssse3"))) static uint8_t const* packed_decode_block_ssse3(
+    uint8_t const* block, size_t groups, int* out) {
+    uint8_t const* p = block + groups;
+    __m128i previous = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi32(1);
+
+    for (size_t g = 0; g < groups; ++g) {
+        uint8_t key = block[g];
+        __m128i bytes = _mm_loadu_si128((__m128i const*)p);
+        __m128i shuffle = _mm_loadu_si128((__m128i const*)packed_shuffles[key]);
+        __m128i v = _mm_shuffle_epi8(bytes, shuffle);
+        p += packed_lengths[key];
+
+        // (v >> 1) ^ -(v & 1), followed by a prefix sum in log2(4) steps
+        __m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, one));
+        v = _mm_xor_si128(_mm_srli_epi32(v, 1), sign);
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi32(v, previous);
+        _mm_storeu_si128((__m128i*)(out + 4 * g), v);
+        previous = _mm_shuffle_epi32(v, 0xFF);
+    }
+
+    return p;
+}
+
+#endif  // HAVE_X86_SIMD
+
+/**
+ * Picks the fastest block decoder supported by the CPU. Must be called before
+ * decoding from several threads.
+ */
+static block_decoder packed_decoder(void) {
+    static block_decoder impl = NULL;
+    if (!impl) {
+        packed_init_tables();
+        impl = packed_decode_block_scalar;
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("ssse3")) impl = packed_decode_block_ssse3;
+#endif
+    }
+    return impl;
+}
+
+/**
+ * Decodes block `b` of a packed file into `out`, which must have room for
+ * PACKED_BLOCK_SIZE values. Returns the number of decoded values.
+ */
+size_t packed_decode_block(struct packed_file const* f, char const* filename, size_t b,
+                           int* out) {
+    block_decoder decode = packed_decoder();  // also fills the tables
+    struct packed_header const* h = f->header;
+    uint64_t begin = f->offsets[b], end = f->offsets[b + 1];
+    size_t n = b + 1 < h->blocks ? PACKED_BLOCK_SIZE : h->count - b * PACKED_BLOCK_SIZE;
+    size_t groups = (n + 3) / 4;
+
+    // The control bytes determine how many value bytes are read, so check them first
+    bool valid = begin <= end && end <= h->data_size && groups <= end - begin;
+    size_t length = groups;
+    for (size_t g = 0; valid && g < groups; ++g) length += packed_lengths[f->data[begin + g]];
+    if (!valid || length != end - begin)
+        exit_with_message("hw1-3: %s: corrupted packed block %zu", filename, b);
+
+    decode(f->data + begin, groups, out);
+    return n;
+}
+
+/**
+ * A contiguous range of blocks of a packed file, summarized by a single thread.
+ */
+struct packed_task {
+    pthread_t thread;
+    struct packed_file const* file;
+    char const* filename;
+    size_t first_block;
+    size_t end_block;
+    struct summary result;
+};
+
+/**
+ * Decodes the blocks [first_block, end_block) one at a time into the summary.
+ */
+void packed_add_blocks(struct packed_file const* f, char const* filename, size_t first_block,
+                       size_t end_block, struct summary* s) {
+    int* buffer = malloc(PACKED_BLOCK_SIZE * sizeof(int));
+    if (!buffer) exit_with_message("hw1-3: out of memory");
+
+    for (size_t b = first_block; b < end_block; ++b) {
+        size_t n = packed_decode_block(f, filename, b, buffer);
+        summary_add_range(s, buffer, n);
+    }
+
+    free(buffer);
+}
+
+static void* packed_worker(void* arg) {
+    struct packed_task* task = arg;
+    packed_add_blocks(task->file, task->filename, task->first_block, task->end_block,
+                      &task->result);
+    return NULL;
+}
+
+/**
+ * Computes the summary of a packed file on `threads` workers, decoding it block by block
+ * straight into the summary, so that the decoded values never leave the cache.
+ */
+void packed_statistics(struct mapped_file const* mapping, char const* filename,
+                       unsigned threads, struct summary_options const* options,
+                       struct summary* out) {
+    struct packed_file f;
+    open_packed_file(mapping, filename, &f);
+
+    size_t blocks = f.header->blocks;
+    // Don't spawn threads for less than a reduction block each
+    size_t max_threads = blocks / (REDUCE_BLOCK_SIZE / PACKED_BLOCK_SIZE);
+    if (threads > max_threads) threads = max_threads;
+    if (threads == 0) threads = 1;
+
+    // Make sure the kernel and decoder are picked before the workers race to do so
+    summary_init(out, options, 0);
+    moments_add_range(&out->moments, NULL, 0);
+    packed_decoder();
+
+    struct packed_task* tasks = calloc(threads, sizeof(struct packed_task));
+    if (!tasks) exit_with_message("hw1-3: out of memory");
+
+    for (unsigned t = 0; t < threads; ++t) {
+        tasks[t].file = &f;
+        tasks[t].filename = filename;
+        tasks[t].first_block = blocks * t / threads;
+        tasks[t].end_block = blocks * (t + 1) / threads;
+        summary_init(&tasks[t].result, options, t + 1);
+        if (t == 0) continue;  // the main thread handles the first blocks itself
+
+        int err = pthread_create(&tasks[t].thread, NULL, packed_worker, tasks + t);
+        if (err) exit_with_message("hw1-3: pthread_create: %s", strerror(err));
+    }
+
+    packed_worker(tasks);
+    for (unsigned t = 0; t < threads; ++t) {
+        if (t > 0) pthread_join(tasks[t].thread, NULL);
+        summary_merge(out, &tasks[t].result);
+        summary_free(&tasks[t].result);
+    }
+
+    free(tasks);
+}
+
+/**
+ * Decodes a whole packed file into a newly allocated array.
+ */
+int* packed_values(struct mapped_file const* mapping, char const* filename, size_t* out_count) {
+    struct packed_file f;
+    open_packed_file(mapping, filename, &f);
+
+    // Every block is decoded in full groups of 4, so leave room for the last one
+    size_t count = f.header->count;
+    int* nums = malloc((count + 4) * sizeof(int));
+    if (!nums) exit_with_message("hw1-3: out of memory");
+
+    for (size_t b = 0; b < f.header->blocks; ++b)
+        packed_decode_block(&f, filename, b, nums + b * PACKED_BLOCK_SIZE);
+
+    *out_count = count;
+    return nums;
+}
+
+/**
+ * Loads a count-prefixed list of numbers, like load_numbers,
+ * but maps the file into memory and parses it in place, without stdio.
+ *
+ * Binary number files are used in place: *out_nums points into the mapping,
+ * which is then returned in *out_mapping and must be released with free_numbers.
+ * Packed files are decoded into a new array.
+ */
+void load_numbers_mmap(char const* filename, size_t* out_nums_count, int** out_nums,
+                       struct mapped_file* out_mapping) {
+    struct mapped_file f;
+    map_file(filename, &f);
+
+    // Binary files need no parsing at all
+    if (is_numfile(&f)) {
+        bool copied;
+        *out_nums = numfile_values(&f, filename, out_nums_count, &copied);
+        if (copied) unmap_file(&f);
+        *out_mapping = f;
+        return;
+    }
+
+    // Packed files are decoded in full
+    if (is_packed_file(&f)) {
+        *out_nums = packed_values(&f, filename, out_nums_count);
+        unmap_file(&f);
+        *out_mapping = f;
+        return;
+    }
+
+    // Read the number of numbers
+    char const* p = f.data;
+    char const* end = f.data + f.size;
+    while (p < end && is_space(*p)) p++;
+    char const* token = p;
+    while (p < end && !is_space(*p)) p++;
+    if (p == token) exit_with_message("hw1-3: missing number count");
+    size_t nums_count = (size_t)parse_token(token, p - token, 0, LLONG_MAX, token - f.data);
+
+    // Parse the numbers
+    int* nums = calloc(nums_count, sizeof(int));
+    if (!nums && nums_count) exit_with_message("hw1-3: out of memory");
+
+    size_t parsed = parse_numbers(&p, end, f.data, nums, nums_count);
+    if (parsed != nums_count)
+        exit_with_message("hw1-3: expected %zu numbers, got %zu", nums_count, parsed);
+
+    unmap_file(&f);
+
+    *out_nums_count = nums_count;
+    *out_nums = nums;
+    out_mapping->data = NULL;
+    out_mapping->size = 0;
+}
+
+/**
+ * Releases numbers returned by load_numbers_mmap.
+ */
+void free_numbers(int* nums, struct mapped_file* mapping) {
+    if (mapping->data)
+        unmap_file(mapping);
+    else
+        free(nums);
+}
+
+/**
+ * Statistics of numbers of any element type supported by number files.
+ * min and max are exact for all of them, as is `sum` for the integer types.
+ */
+struct typed_stats {
+    size_t count;
+    long double min, max;
+    __int128 sum;
+    double mean, variance;
+};
+
+/**
+ * Generates the statistics kernel of a narrow integer type, whose squares can be summed
+ * exactly in 64-bit lanes over a whole block. Like moments_add_range, it makes a single pass,
+ * and so streams proportionally less memory than the int kernels.
+ */
+#define DEFINE_NARROW_INT_STATS(NAME, TYPE, TYPE_MIN, TYPE_MAX)                                \
+    static void NAME(void const* data, size_t n, struct typed_stats* out) {                    \
+        TYPE const* x = data;                                                                  \
+        TYPE min[SUM_LANES], max[SUM_LANES];                                                   \
+        for (size_t l = 0; l < SUM_LANES; ++l) {                                               \
+            min[l] = TYPE_MAX;                                                                 \
+            max[l] = TYPE_MIN;                                                                 \
+        }                                                                                      \
+                                                                                               \
+        struct moments m;                                                                      \
+        moments_init(&m);                                                                      \
+        for (size_t start = 0; start < n; start += SUM_BLOCK_SIZE) {                           \
+            size_t end = n - start < SUM_BLOCK_SIZE ? n : start + SUM_BLOCK_SIZE;              \
+            int64_t sum[SUM_LANES] = {0}, sum_sq[SUM_LANES] = {0};                             \
+                                                                                               \
+            size_t i = start;                                                                  \
+            for (; i + SUM_LANES <= end; i += SUM_LANES) {                                     \
+                for (size_t l = 0; l < SUM_LANES; ++l) {                                       \
+                    TYPE v = x[i + l];                                                         \
+                    sum[l] += v;                                                               \
+                    sum_sq[l] += (int64_t)v * v;                                               \
+                    min[l] = v < min[l] ? v : min[l];                                          \
+                    max[l] = v > max[l] ? v : max[l];                                          \
+                }                                                                              \
+            }                                                                                  \
+            for (; i < end; ++i) {                                                             \
+                TYPE v = x[i];                                                                 \
+                sum[0] += v;                                                                   \
+                sum_sq[0] += (int64_t)v * v;                                                   \
+                min[0] = v < min[0] ? v : min[0];                                              \
+                max[0] = v > max[0] ? v : max[0];                                              \
+            }                                                                                  \
+                                                                                               \
+            for (size_t l = 0; l < SUM_LANES; ++l) {                                           \
+                m.sum += sum[l];                                                               \
+                m.sum_sq += (unsigned __int128)sum_sq[l];                                      \
+            }                                                                                  \
+        }                                                                                      \
+                                                                                               \
+        for (size_t l = 1; l < SUM_LANES; ++l) {                                               \
+            if (min[l] < min[0]) min[0] = min[l];                                              \
+            if (max[l] > max[0]) max[0] = max[l];                                              \
+        }                                                                                      \
+                                                                                               \
+        m.count = n;                                                                           \
+        *out = (struct typed_stats){                                                           \
+            .count = n,                                                                        \
+            .min = n ? min[0] : INT_MAX,                                                       \
+            .max = n ? max[0] : INT_MIN,                                                       \
+            .sum = m.sum,                                                                      \
+            .mean = moments_mean(&m),                                                          \
+            .variance = moments_variance(&m),                                                  \
+        };                                                                                     \
+    }
+
+/**
+ * Generates the statistics kernel of a wide type, whose squares can't be summed exactly.
+ * The first pass finds the extremes and the sum, accumulated per block in SUM_LANES lanes
+ * of type ACC and folded into the total with FOLD(total, compensation, block_sum).
+ * The second pass sums the squared deviations from the mean like find_variance.
+ */
+#define DEFINE_WIDE_STATS(NAME, TYPE, ACC, TOTAL, FOLD)                                        \
+    static void NAME(void const* data, size_t n, struct typed_stats* out) {                    \
+        TYPE const* x = data;                                                                  \
+        TYPE min[SUM_LANES], max[SUM_LANES];                                                   \
+        for (size_t l = 0; l < SUM_LANES; ++l) min[l] = max[l] = n ? x[0] : 0;                 \
+                                                                                               \
+        TOTAL total = 0, total_c = 0;                                                          \
+        for (size_t start = 0; start < n; start += SUM_BLOCK_SIZE) {                           \
+            size_t end = n - start < SUM_BLOCK_SIZE ? n : start + SUM_BLOCK_SIZE;              \
+            ACC sum[SUM_LANES] = {0};                                                          \
+                                                                                               \
+            size_t i = start;                                                                  \
+            for (; i + SUM_LANES <= end; i += SUM_LANES) {                                     \
+                for (size_t l = 0; l < SUM_LANES; ++l) {                                       \
+                    TYPE v = x[i + l];                                                         \
+                    sum[l] += v;                                                               \
+                    min[l] = v < min[l] ? v : min[l];                                          \
+                    max[l] = v > max[l] ? v : max[l];                                          \
+                }                                                                              \
+            }                                                                                  \
+            for (; i < end; ++i) {                                                             \
+                TYPE v = x[i];                                                                 \
+                sum[0] += v;                                                                   \
+                min[0] = v < min[0] ? v : min[0];                                              \
+                max[0] = v > max[0] ? v : max[0];                                              \
+            }                                                                                  \
+                                                                                               \
+            for (size_t l = 0; l < SUM_LANES; ++l) FOLD(total, total_c, sum[l]);               \
+        }                                                                                      \
+                                                                                               \
+        for (size_t l = 1; l < SUM_LANES; ++l) {                                               \
+            if (min[l] < min[0]) min[0] = min[l];                                              \
+            if (max[l] > max[0]) max[0] = max[l];                                              \
+        }                                                                                      \
+        double mean = (double)((long double)total / (long double)n);                           \
+                                                                                               \
+        double sum_sq = 0.0, sum_sq_c = 0.0, sum_dev = 0.0, sum_dev_c = 0.0;                   \
+        for (size_t start = 0; start < n; start += SUM_BLOCK_SIZE) {                           \
+            size_t end = n - start < SUM_BLOCK_SIZE ? n : start + SUM_BLOCK_SIZE;              \
+            double sq[SUM_LANES] = {0}, dev[SUM_LANES] = {0};                                  \
+                                                                                               \
+            size_t i = start;                                                                  \
+            for (; i + SUM_LANES <= end; i += SUM_LANES) {                                     \
+                for (size_t l = 0; l < SUM_LANES; ++l) {                                       \
+                    double i_diff = (double)x[i + l] - mean;                                   \
+                    sq[l] += i_diff * i_diff;                                                  \
+                    dev[l] += i_diff;                                                          \
+                }                                                                              \
+            }                                                                                  \
+            for (; i < end; ++i) {                                                             \
+                double i_diff = (double)x[i] - mean;                                           \
+                sq[0] += i_diff * i_diff;                                                      \
+                dev[0] += i_diff;                                                              \
+            }                                                                                  \
+                                                                                               \
+            for (size_t l = 0; l < SUM_LANES; ++l) {                                           \
+                kahan_add(&sum_sq, &sum_sq_c, sq[l]);                                          \
+                kahan_add(&sum_dev, &sum_dev_c, dev[l]);                                       \
+            }                                                                                  \
+        }                                                                                      \
+                                                                                               \
+        *out = (struct typed_stats){                                                           \
+            .count = n,                                                                        \
+            .min = min[0],                                                                     \
+            .max = max[0],                                                                     \
+            .sum = (__int128)total,                                                            \
+            .mean = mean,                                                                      \
+            .variance = (sum_sq - sum_dev * sum_dev / (double)n) / (double)n,                  \
+        };                                                                                     \
+    }
+
+#define EXACT_FOLD(total, compensation, x) ((void)(compensation), (total) += (x))
+#define KAHAN_FOLD(total, compensation, x) kahan_add(&(total), &(compensation), (x))
+
+DEFINE_NARROW_INT_STATS(stats_int16_scalar, int16_t, INT16_MIN, INT16_MAX)
+DEFINE_WIDE_STATS(stats_int64, int64_t, __int128, __int128, EXACT_FOLD)
+DEFINE_WIDE_STATS(stats_float32, float, double, double, KAHAN_FOLD)
+DEFINE_WIDE_STATS(stats_float64, double, double, double, KAHAN_FOLD)
+
+typedef void (*stats_kernel)(void const* data, size_t n, struct typed_stats* out);
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * int16 kernel for AVX2, which the compiler doesn't manage to vectorize on its own:
+ * pmaddwd sums adjacent values, and adjacent squares, which fit an unsigned 32-bit lane
+ * even for two -32768s. Both are widened only once per block.
+ */
+__attribute__((target("avx2"))) static void stats_int16_avx2(void const* data, size_t n,
+                                                              struct typed_stats* out) {
+    int16_t const* x = data;
+    __m256i const ones = _mm256_set1_epi16(1);
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i min = _mm256_set1_epi16(INT16_MAX);
+    __m256i max = _mm256_set1_epi16(INT16_MIN);
+
+    struct moments m;
+    moments_init(&m);
+    m.count = n;
+
+    size_t i = 0;
+    while (i + 16 <= n) {
+        size_t end = n - i < SUM_BLOCK_SIZE ? n : i + SUM_BLOCK_SIZE;
+        __m256i sum = zero;     // 8 x int32
+        __m256i sum_sq = zero;  // 4 x uint64
+
+        for (; i + 16 <= end; i += 16) {
+            __m256i v = _mm256_loadu_si256((__m256i const*)(x + i));
+            min = _mm256_min_epi16(min, v);
+            max = _mm256_max_epi16(max, v);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v, ones));
+
+            __m256i sq = _mm256_madd_epi16(v, v);
+            sum_sq = _mm256_add_epi64(sum_sq, _mm256_add_epi64(_mm256_unpacklo_epi32(sq, zero),
+                                                               _mm256_unpackhi_epi32(sq, zero)));
+        }
+
+        int lanes[8];
+        unsigned long long sq_lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, sum);
+        _mm256_storeu_si256((__m256i*)sq_lanes, sum_sq);
+        for (size_t l = 0; l < 8; ++l) m.sum += lanes[l];
+        for (size_t l = 0; l < 4; ++l) m.sum_sq += sq_lanes[l];
+    }
+
+    int16_t mins[16], maxs[16];
+    _mm256_storeu_si256((__m256i*)mins, min);
+    _mm256_storeu_si256((__m256i*)maxs, max);
+    for (size_t l = 0; l < 16; ++l) {
+        if (mins[l] < m.min) m.min = mins[l];
+        if (maxs[l] > m.max) m.max = maxs[l];
+    }
+
+    for (; i < n; ++i) {
+        if (x[i] < m.min) m.min = x[i];
+        if (x[i] > m.max) m.max = x[i];
+        m.sum += x[i];
+        m.sum_sq += (unsigned __int128)((long long)x[i] * x[i]);
+    }
+
+    *out = (struct typed_stats){
+        .count = n,
+        .min = m.min,
+        .max = m.max,
+        .sum = m.sum,
+        .mean = moments_mean(&m),
+        .variance = moments_variance(&m),
+    };
+}
+
+#endif  // HAVE_X86_SIMD
+
+static void stats_int16(void const* data, size_t n, struct typed_stats* out) {
+    static stats_kernel kernel = NULL;
+    if (!kernel) {
+        kernel = stats_int16_scalar;
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) kernel = stats_int16_avx2;
+#endif
+    }
+    kernel(data, n, out);
+}
+
+/**
+ * Numbers of any element type supported by number files, either owned or mapped.
+ */
+struct typed_numbers {
+    uint32_t type;  // one of NUMFILE_INT16, ...
+    size_t count;
+    void const* data;
+    struct mapped_file mapping;  // data points into the mapping, unless mapping.data is NULL
+};
+
+/**
+ * Returns true if any byte of [p, end) can only appear in floating-point numbers.
+ */
+static bool has_float_syntax(char const* p, char const* end) {
+    // Fixed-size, branchless chunks, so that the loop vectorizes
+    unsigned char found = 0;
+    for (; end - p >= 64 && !found; p += 64) {
+        for (size_t i = 0; i < 64; ++i) {
+            unsigned char c = (unsigned char)p[i] | 0x20;  // lowercase letters, '.' stays the same
+            found |= (c == '.') | (c == 'e') | (c == 'i') | (c == 'n');
+        }
+    }
+    for (; p < end; ++p) {
+        unsigned char c = (unsigned char)*p | 0x20;
+        found |= (c == '.') | (c == 'e') | (c == 'i') | (c == 'n');
+    }
+    return found;
+}
+
+/**
+ * Parses whitespace-separated floating-point numbers, like parse_numbers.
+ */
+static size_t parse_double_numbers(char const** p, char const* end, char const* origin,
+                                   double* out, size_t capacity) {
+    char const* q = *p;
+    size_t n = 0;
+
+    while (n < capacity) {
+        while (q < end && is_space(*q)) q++;
+        if (q == end) break;
+
+        char const* token = q;
+        while (q < end && !is_space(*q)) q++;
+
+        // strtod needs a terminated string
+        char buffer[64];
+        size_t length = q - token;
+        char* token_end = NULL;
+        if (length < sizeof(buffer)) {
+            memcpy(buffer, token, length);
+            buffer[length] = '\0';
+            out[n] = strtod(buffer, &token_end);
+        }
+        if (token_end != buffer + length)
+            exit_with_message("hw1-3: malformed number \"%.*s\" at byte %zu", (int)length, token,
+                              (size_t)(token - origin));
+        n++;
+    }
+
+    *p = q;
+    return n;
+}
+
+/**
+ * Converts the values in `buffer` to a narrower element type in place,
+ * going front to back, so that each value is read before it's overwritten.
+ */
+#define NARROW_IN_PLACE(FROM, TO, buffer, count)                            \
+    do {                                                                    \
+        for (size_t i_ = 0; i_ < (count); ++i_) {                           \
+            FROM from_;                                                     \
+            memcpy(&from_, (char*)(buffer) + i_ * sizeof(FROM), sizeof(FROM)); \
+            TO to_ = (TO)from_;                                             \
+            memcpy((char*)(buffer) + i_ * sizeof(TO), &to_, sizeof(TO));    \
+        }                                                                   \
+    } while (0)
+
+/**
+ * Converts the values in `buffer` to a wider element type in place, going back to front.
+ * The buffer must already have room for `count` values of the wider type.
+ */
+#define WIDEN_IN_PLACE(FROM, TO, buffer, count)                             \
+    do {                                                                    \
+        for (size_t i_ = (count); i_-- > 0;) {                              \
+            FROM from_;                                                     \
+            memcpy(&from_, (char*)(buffer) + i_ * sizeof(FROM), sizeof(FROM)); \
+            TO to_ = (TO)from_;                                             \
+            memcpy((char*)(buffer) + i_ * sizeof(TO), &to_, sizeof(TO));    \
+        }                                                                   \
+    } while (0)
+
+/**
+ * Reallocates `buffer` for `count` values of `size` bytes, exiting if out of memory.
+ */
+static char* resize_typed_buffer(char* buffer, size_t count, size_t size) {
+    if (!count) return buffer;
+    char* resized = realloc(buffer, count * size);
+    if (!resized) exit_with_message("hw1-3: out of memory");
+    return resized;
+}
+
+/**
+ * Loads the numbers with the narrowest element type able to hold all of them.
+ * Binary number files are used in place, with the type from their header,
+ * and packed files are decoded as ints.
+ *
+ * Text files are parsed one block at a time (as doubles, if any number looks like one)
+ * and stored as int32 or float, until a value doesn't fit. The stored values are then
+ * widened in place to int64 or double. Ints which all fit in int16 are narrowed at the end,
+ * so memory never exceeds that of an int array, unless the values need more.
+ */
+void load_typed_numbers(char const* filename, struct typed_numbers* out) {
+    struct mapped_file f;
+    map_file(filename, &f);
+
+    if (is_numfile(&f)) {
+        out->data = numfile_typed_values(&f, filename, &out->type, &out->count);
+        out->mapping = f;
+        return;
+    }
+    if (is_packed_file(&f)) {
+        out->type = NUMFILE_INT32;
+        out->data = packed_values(&f, filename, &out->count);
+        out->mapping = (struct mapped_file){0};
+        unmap_file(&f);
+        return;
+    }
+
+    // Read the number of numbers
+    char const* p = f.data;
+    char const* end = f.data + f.size;
+    while (p < end && is_space(*p)) p++;
+    char const* token = p;
+    while (p < end && !is_space(*p)) p++;
+    if (p == token) exit_with_message("hw1-3: missing number count");
+    size_t count = (size_t)parse_token(token, p - token, 0, LLONG_MAX, token - f.data);
+
+    bool floating = has_float_syntax(p, end);
+    size_t size = 4;
+    char* buffer = count ? malloc(count * size) : NULL;
+    union {
+        long long ints[REDUCE_BLOCK_SIZE];
+        double floats[REDUCE_BLOCK_SIZE];
+    }* block = malloc(sizeof(*block));
+    if ((!buffer && count) || !block) exit_with_message("hw1-3: out of memory");
+
+    size_t parsed = 0;
+    long long min = 0, max = 0;
+    while (parsed < count) {
+        size_t capacity = count - parsed < REDUCE_BLOCK_SIZE ? count - parsed : REDUCE_BLOCK_SIZE;
+        size_t n;
+
+        if (floating) {
+            n = parse_double_numbers(&p, end, f.data, block->floats, capacity);
+            double const* values = block->floats;
+
+            bool fits_float = size == 4;
+            for (size_t i = 0; i < n && fits_float; ++i)
+                fits_float = (double)(float)values[i] == values[i] || values[i] != values[i];
+            if (size == 4 && !fits_float) {
+                size = sizeof(double);
+                buffer = resize_typed_buffer(buffer, count, size);
+                WIDEN_IN_PLACE(float, double, buffer, parsed);
+            }
+
+            if (size == 4)
+                for (size_t i = 0; i < n; ++i) ((float*)buffer)[parsed + i] = (float)values[i];
+            else
+                for (size_t i = 0; i < n; ++i) ((double*)buffer)[parsed + i] = values[i];
+        } else {
+            n = parse_wide_numbers(&p, end, f.data, block->ints, capacity);
+            long long const* values = block->ints;
+
+            for (size_t i = 0; i < n; ++i) {
+                min = values[i] < min ? values[i] : min;
+                max = values[i] > max ? values[i] : max;
+            }
+            if (size == 4 && (min < INT_MIN || max > INT_MAX)) {
+                size = sizeof(long long);
+                buffer = resize_typed_buffer(buffer, count, size);
+                WIDEN_IN_PLACE(int, long long, buffer, parsed);
+            }
+
+            if (size == 4)
+                for (size_t i = 0; i < n; ++i) ((int*)buffer)[parsed + i] = (int)values[i];
+            else
+                for (size_t i = 0; i < n; ++i) ((long long*)buffer)[parsed + i] = values[i];
+        }
+
+        if (n == 0) break;
+        parsed += n;
+    }
+    if (parsed != count) exit_with_message("hw1-3: expected %zu numbers, got %zu", count, parsed);
+    free(block);
+    unmap_file(&f);
+
+    if (floating) {
+        out->type = size == 4 ? NUMFILE_FLOAT32 : NUMFILE_FLOAT64;
+    } else if (size == 4 && count && min >= INT16_MIN && max <= INT16_MAX) {
+        out->type = NUMFILE_INT16;
+        NARROW_IN_PLACE(int, int16_t, buffer, count);
+        buffer = resize_typed_buffer(buffer, count, sizeof(int16_t));
+    } else {
+        out->type = size == 4 ? NUMFILE_INT32 : NUMFILE_INT64;
+    }
+
+    out->count = count;
+    out->data = buffer;
+    out->mapping = (struct mapped_file){0};
+}
+
+void free_typed_numbers(struct typed_numbers* nums) {
+    if (nums->mapping.data)
+        unmap_file(&nums->mapping);
+    else
+        free((void*)nums->data);
+}
+
+/**
+ * Computes the statistics of the numbers with the kernel for their element type.
+ * ints are reduced by reduce_numbers on `threads` workers.
+ */
+void typed_statistics(struct typed_numbers const* nums, unsigned threads,
+                      struct typed_stats* out) {
+    switch (nums->type) {
+        case NUMFILE_INT16:
+            stats_int16(nums->data, nums->count, out);
+            break;
+        case NUMFILE_INT32: {
+            struct summary s;
+            reduce_numbers(nums->data, nums->count, threads, &(struct summary_options){0}, &s);
+            struct moments const* m = &s.moments;
+            *out = (struct typed_stats){
+                .count = m->count,
+                .min = m->min,
+                .max = m->max,
+                .sum = m->sum,
+                .mean = moments_mean(m),
+                .variance = moments_variance(m),
+            };
+            summary_free(&s);
+            break;
+        }
+        case NUMFILE_INT64:
+            stats_int64(nums->data, nums->count, out);
+            break;
+        case NUMFILE_FLOAT32:
+            stats_float32(nums->data, nums->count, out);
+            break;
+        case NUMFILE_FLOAT64:
+            stats_float64(nums->data, nums->count, out);
+            break;
+        default:
+            assert(false && "unknown element type");
+    }
+}
+
+/**
+ * Prints typed statistics like print_statistics, with min and max in full precision.
+ */
+void print_typed_statistics(uint32_t type, struct typed_stats const* s) {
+    puts("#data\tmin\tmax\tmean\tvariance");
+    if (type == NUMFILE_FLOAT32 || type == NUMFILE_FLOAT64) {
+        int digits = type == NUMFILE_FLOAT32 ? 9 : 17;
+        printf("%zu\t%.*Lg\t%.*Lg\t%.1f\t%.1f\n", s->count, digits, s->min, digits, s->max,
+               s->mean, s->variance);
+    } else {
+        printf("%zu\t%.0Lf\t%.0Lf\t%.1f\t%.1f\n", s->count, s->min, s->max, s->mean,
+               s->variance);
+    }
+}
+
+/**
+ * Checks the statistics computed from a mapped binary number file against the ones
+ * precomputed in its header, if any, exiting if they disagree.
+ */
+void check_numfile_stats(struct mapped_file const* f, char const* filename,
+                         struct typed_stats const* s) {
+    struct numfile_header const* header = (struct numfile_header const*)f->data;
+    if (!(header->flags & NUMFILE_HAS_STATS) || !s->count) return;
+
+    if (header->min != (int64_t)s->min || header->max != (int64_t)s->max ||
+        header->sum_lo != (uint64_t)s->sum || header->sum_hi != (int64_t)(s->sum >> 64))
+        exit_with_message("hw1-3: %s: corrupted, the values don't match the statistics "
+                          "in the header",
+                          filename);
+}
+
+/**
+ * Writes the numbers as a binary number file, with precomputed statistics for integer types.
+ */
+void write_numfile(char const* filename, struct typed_numbers const* nums,
+                   struct typed_stats const* s) {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    exit_with_message("hw1-3: %s: binary number files require a little-endian host", filename);
+#endif
+
+    bool integral = nums->type != NUMFILE_FLOAT32 && nums->type != NUMFILE_FLOAT64;
+    struct numfile_header header = {
+        .type = nums->type,
+        .count = nums->count,
+    };
+    if (integral) {
+        header.flags = NUMFILE_HAS_STATS;
+        header.min = (int64_t)s->min;
+        header.max = (int64_t)s->max;
+        header.sum_lo = (uint64_t)s->sum;
+        header.sum_hi = (int64_t)(s->sum >> 64);
+    }
+    memcpy(header.magic, NUMFILE_MAGIC, sizeof(header.magic));
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("fopen");
+        exit(1);
+    }
+
+    size_t size = numfile_type_size(nums->type);
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(nums->data, size, nums->count, fp) != nums->count || fclose(fp) != 0) {
+        perror("fwrite");
+        exit(1);
+    }
+}
+
+/**
+ * Writes the numbers as a packed file.
+ */
+void write_packed_file(char const* filename, int const* nums, size_t count) {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    exit_with_message("hw1-3: %s: packed files require a little-endian host", filename);
+#endif
+
+    struct packed_header header = {
+        .count = count,
+        .block_size = PACKED_BLOCK_SIZE,
+        .blocks = (count + PACKED_BLOCK_SIZE - 1) / PACKED_BLOCK_SIZE,
+    };
+    memcpy(header.magic, PACKED_MAGIC, sizeof(header.magic));
+
+    // Every group of 4 values takes at most 17 bytes
+    uint64_t* offsets = malloc((header.blocks + 1) * sizeof(uint64_t));
+    uint8_t* data = malloc((count / 4 + header.blocks) * 17 + PACKED_PADDING);
+    if (!offsets || !data) exit_with_message("hw1-3: out of memory");
+
+    offsets[0] = 0;
+    for (size_t b = 0; b < header.blocks; ++b) {
+        size_t n = count - b * PACKED_BLOCK_SIZE;
+        if (n > PACKED_BLOCK_SIZE) n = PACKED_BLOCK_SIZE;
+        offsets[b + 1] =
+            offsets[b] + packed_encode_block(nums + b * PACKED_BLOCK_SIZE, n, data + offsets[b]);
+    }
+    header.data_size = offsets[header.blocks];
+    memset(data + header.data_size, 0, PACKED_PADDING);
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("fopen");
+        exit(1);
+    }
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(offsets, sizeof(uint64_t), header.blocks + 1, fp) != header.blocks + 1 ||
+        fwrite(data, 1, header.data_size + PACKED_PADDING, fp) !=
+            header.data_size + PACKED_PADDING ||
+        fclose(fp) != 0) {
+        perror("fwrite");
+        exit(1);
+    }
+
+    free(offsets);
+    free(data);
+}
+
+/**
+ * Returns a monotonic timestamp in seconds, for benchmarking.
+ */
+double now_in_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Times load_numbers (fscanf) against load_numbers_mmap on the same file,
+ * verifying both return the same numbers, and prints the results to stderr.
+ */
+void benchmark_loaders(char const* filename) {
+    size_t count_fscanf, count_mmap;
+    int *nums_fscanf, *nums_mmap;
+    struct mapped_file mapping;
+
+    double start = now_in_sec();
+    load_numbers_mmap(filename, &count_mmap, &nums_mmap, &mapping);
+    double time_mmap = now_in_sec() - start;
+
+    fprintf(stderr, "loader\tseconds\tMnums/s\n");
+    fprintf(stderr, "mmap\t%.4f\t%.1f\n", time_mmap, count_mmap / time_mmap * 1e-6);
+
+    // fscanf can only read text files
+    if (mapping.data) {
+        free_numbers(nums_mmap, &mapping);
+        return;
+    }
+
+    start = now_in_sec();
+    load_numbers(filename, &count_fscanf, &nums_fscanf);
+    double time_fscanf = now_in_sec() - start;
+
+    if (count_fscanf != count_mmap ||
+        memcmp(nums_fscanf, nums_mmap, count_mmap * sizeof(int)) != 0)
+        exit_with_message("hw1-3: loaders disagree on %s", filename);
+
+    fprintf(stderr, "fscanf\t%.4f\t%.1f\n", time_fscanf, count_fscanf / time_fscanf * 1e-6);
+    fprintf(stderr, "speedup\t%.2fx\n", time_fscanf / time_mmap);
+
+    free(nums_fscanf);
+    free_numbers(nums_mmap, &mapping);
+}
+
+/**
+ * Returns the relative error of `value`, or the absolute error if `reference` is zero.
+ */
+static long double relative_error(double value, long double reference) {
+    long double error = fabsl(value - reference);
+    return reference != 0.0L ? error / fabsl(reference) : error;
+}
+
+/**
+ * Times find_mean and find_variance against plain sequential double loops,
+ * and compares the results of both with the exact moments, printing them to stderr.
+ */
+void benchmark_summation(size_t nums_count, int* nums) {
+    // Exact reference, from the 128-bit integer moments
+    struct moments m;
+    moments_init(&m);
+    moments_add_range(&m, nums, nums_count);
+    long double ref_mean = (long double)m.sum / (long double)nums_count;
+    long double ref_variance = moments_variance(&m);
+
+    // Plain sequential loops, as a baseline
+    double start = now_in_sec();
+    double naive_sum = 0.0, naive_sq = 0.0;
+    for (size_t i = 0; i < nums_count; ++i) naive_sum += (double)nums[i];
+    double naive_mean = naive_sum / (double)nums_count;
+    for (size_t i = 0; i < nums_count; ++i) {
+        double i_diff = nums[i] - naive_mean;
+        naive_sq += i_diff * i_diff;
+    }
+    double naive_variance = naive_sq / (double)nums_count;
+    double time_naive = now_in_sec() - start;
+
+    start = now_in_sec();
+    double mean = find_mean(nums_count, nums);
+    double variance = find_variance(nums_count, nums, mean);
+    double time_blocked = now_in_sec() - start;
+
+    fprintf(stderr, "summation\tseconds\tmean rel. error\tvariance rel. error\n");
+    fprintf(stderr, "naive\t%.4f\t%.3Le\t%.3Le\n", time_naive,
+            relative_error(naive_mean, ref_mean), relative_error(naive_variance, ref_variance));
+    fprintf(stderr, "blocked\t%.4f\t%.3Le\t%.3Le\n", time_blocked, relative_error(mean, ref_mean),
+            relative_error(variance, ref_variance));
+}
+
+/**
+ * A value in a sliding window, with its arrival time.
+ */
+struct window_entry {
+    int value;
+    double time;
+};
+
+/**
+ * Statistics over the last values of an unbounded stream: at most `max_count` values,
+ * and only those which arrived less than `max_age` seconds ago (0 disables either bound).
+ *
+ * Entries are kept in a ring indexed by their sequence number. Min and max come from
+ * monotonic deques of sequence numbers (increasing values for the min, decreasing for the max),
+ * and the exact sums are updated as values enter and leave, so every value costs
+ * amortized O(1) and a window is never recomputed from scratch.
+ */
+struct sliding_window {
+    size_t max_count;
+    double max_age;
+
+    size_t capacity;  // power of two
+    struct window_entry* entries;
+    uint64_t first;  // sequence number of the oldest value in the window
+    uint64_t next;   // sequence number of the next value
+
+    uint64_t* min_deque;  // rings of sequence numbers, with the same capacity as entries
+    size_t min_head;
+    size_t min_len;
+    uint64_t* max_deque;
+    size_t max_head;
+    size_t max_len;
+
+    __int128 sum;
+    unsigned __int128 sum_sq;
+};
+
+void sliding_window_init(struct sliding_window* w, size_t max_count, double max_age) {
+    memset(w, 0, sizeof(*w));
+    w->max_count = max_count;
+    w->max_age = max_age;
+}
+
+void sliding_window_free(struct sliding_window* w) {
+    free(w->entries);
+    free(w->min_deque);
+    free(w->max_deque);
+}
+
+static inline struct window_entry* window_entry_at(struct sliding_window const* w,
+                                                   uint64_t seq) {
+    return w->entries + (seq & (w->capacity - 1));
+}
+
+/**
+ * Copies `count` items of a ring starting at `head` to the start of a new ring.
+ */
+static uint64_t* regrow_ring(uint64_t* ring, size_t capacity, size_t head, size_t count,
+                             size_t new_capacity) {
+    uint64_t* grown = malloc(new_capacity * sizeof(uint64_t));
+    if (!grown) exit_with_message("hw1-3: out of memory");
+    for (size_t i = 0; i < count; ++i) grown[i] = ring[(head + i) & (capacity - 1)];
+    free(ring);
+    return grown;
+}
+
+static void sliding_window_grow(struct sliding_window* w) {
+    size_t capacity = w->capacity ? 2 * w->capacity : 1024;
+
+    struct window_entry* entries = malloc(capacity * sizeof(struct window_entry));
+    if (!entries) exit_with_message("hw1-3: out of memory");
+    for (uint64_t seq = w->first; seq < w->next; ++seq)
+        entries[seq & (capacity - 1)] = *window_entry_at(w, seq);
+
+    w->min_deque = regrow_ring(w->min_deque, w->capacity, w->min_head, w->min_len, capacity);
+    w->max_deque = regrow_ring(w->max_deque, w->capacity, w->max_head, w->max_len, capacity);
+    w->min_head = 0;
+    w->max_head = 0;
+
+    free(w->entries);
+    w->entries = entries;
+    w->capacity = capacity;
+}
+
+static void sliding_window_evict(struct sliding_window* w) {
+    int x = window_entry_at(w, w->first)->value;
+    w->sum -= x;
+    w->sum_sq -= (unsigned __int128)((long long)x * x);
+
+    if (w->min_len && w->min_deque[w->min_head] == w->first) {
+        w->min_head = (w->min_head + 1) & (w->capacity - 1);
+        w->min_len--;
+    }
+    if (w->max_len && w->max_deque[w->max_head] == w->first) {
+        w->max_head = (w->max_head + 1) & (w->capacity - 1);
+        w->max_len--;
+    }
+
+    w->first++;
+}
+
+/**
+ * Drops values which fell out of the time window.
+ */
+void sliding_window_expire(struct sliding_window* w, double now) {
+    while (w->max_age > 0.0 && w->first < w->next &&
+           now - window_entry_at(w, w->first)->time > w->max_age)
+        sliding_window_evict(w);
+}
+
+void sliding_window_push(struct sliding_window* w, int x, double now) {
+    if (w->next - w->first == w->capacity) sliding_window_grow(w);
+
+    uint64_t seq = w->next++;
+    *window_entry_at(w, seq) = (struct window_entry){x, now};
+    w->sum += x;
+    w->sum_sq += (unsigned __int128)((long long)x * x);
+
+    // Values which can never again be the minimum (or maximum) are dropped from the deques
+    size_t mask = w->capacity - 1;
+    while (w->min_len &&
+           window_entry_at(w, w->min_deque[(w->min_head + w->min_len - 1) & mask])->value >= x)
+        w->min_len--;
+    w->min_deque[(w->min_head + w->min_len++) & mask] = seq;
+
+    while (w->max_len &&
+           window_entry_at(w, w->max_deque[(w->max_head + w->max_len - 1) & mask])->value <= x)
+        w->max_len--;
+    w->max_deque[(w->max_head + w->max_len++) & mask] = seq;
+
+    // Evict the values which fell out of the window
+    if (w->max_count && w->next - w->first > w->max_count) sliding_window_evict(w);
+    sliding_window_expire(w, now);
+}
+
+/**
+ * Returns the statistics of the values currently in the window.
+ */
+void sliding_window_moments(struct sliding_window const* w, struct moments* out) {
+    moments_init(out);
+    out->count = w->next - w->first;
+    out->sum = w->sum;
+    out->sum_sq = w->sum_sq;
+    if (out->count) {
+        out->min = window_entry_at(w, w->min_deque[w->min_head])->value;
+        out->max = window_entry_at(w, w->max_deque[w->max_head])->value;
+    }
+}
+
+/**
+ * Reads integers from `fd` until EOF (no count header), printing the statistics
+ * of the sliding window after every `every` values.
+ */
+void window_statistics(int fd, size_t max_count, double max_age, size_t every) {
+    struct number_stream s = {.fd = fd, .buffer = malloc(STREAM_CHUNK_SIZE)};
+    if (!s.buffer) exit_with_message("hw1-3: out of memory");
+
+    struct sliding_window w;
+    sliding_window_init(&w, max_count, max_age);
+
+    puts("#seen\t#data\tmin\tmax\tmean\tvariance");
+    size_t start, length;
+    struct moments m;
+    while ((length = number_stream_next_token(&s, &start)) > 0) {
+        int x = (int)parse_token(s.buffer + start, length, INT_MIN, INT_MAX, s.offset + start);
+        sliding_window_push(&w, x, max_age > 0.0 ? now_in_sec() : 0.0);
+
+        if (w.next % every == 0) {
+            sliding_window_moments(&w, &m);
+            printf("%llu\t%zu\t%d\t%d\t%.1f\t%.1f\n", (unsigned long long)w.next, m.count, m.min,
+                   m.max, moments_mean(&m), moments_variance(&m));
+            fflush(stdout);
+        }
+    }
+
+    // Report the last, partial period
+    if (w.next % every != 0) {
+        if (max_age > 0.0) sliding_window_expire(&w, now_in_sec());
+        sliding_window_moments(&w, &m);
+        printf("%llu\t%zu\t%d\t%d\t%.1f\t%.1f\n", (unsigned long long)w.next, m.count, m.min,
+               m.max, moments_mean(&m), moments_variance(&m));
+    }
+
+    sliding_window_free(&w);
+    free(s.buffer);
+}
+
+/**
+ * Number of values summarized by a single block of a range index.
+ */
+#define INDEX_BLOCK_SIZE 1024
+
+/**
+ * Range index files start with this header, followed by:
+ * - `__int128 prefix_sum[blocks + 1]`: sum of all values in blocks [0, i),
+ * - `unsigned __int128 prefix_sum_sq[blocks + 1]`: the same for the squares of the values,
+ * - `int min_table[levels][blocks]`: sparse table, where min_table[j][i] is
+ *   the minimum of blocks [i, i + 2^j),
+ * - `int max_table[levels][blocks]`: the same for the maximum.
+ *
+ * The values themselves are mapped from the data file, which must be a binary number file
+ * of integers. Its size and modification time (with nanoseconds) are recorded
+ * to detect stale indices.
+ */
+struct index_header {
+    char magic[8];
+    uint64_t count;
+    uint64_t block_size;
+    uint64_t blocks;
+    uint64_t levels;
+    uint64_t data_size;
+    int64_t data_mtime;
+    int64_t data_mtime_nsec;
+};
+
+static_assert(sizeof(struct index_header) == 64, "index header must be 64 bytes");
+
+#define INDEX_MAGIC "KNU\x01IDX3"
+
+/**
+ * A range index, either being built or mapped from a file.
+ */
+struct range_index {
+    struct index_header const* header;
+    __int128 const* prefix_sum;
+    unsigned __int128 const* prefix_sum_sq;
+    int const* min_table;
+    int const* max_table;
+    void const* values;  // mapped from the data file
+    uint32_t type;       // NUMFILE_INT16, NUMFILE_INT32 or NUMFILE_INT64
+};
+
+static size_t index_file_size(uint64_t blocks, uint64_t levels) {
+    return sizeof(struct index_header) + (blocks + 1) * 2 * sizeof(__int128) +
+           2 * levels * blocks * sizeof(int);
+}
+
+/**
+ * Points the range index arrays at their place after the header.
+ */
+static void range_index_layout(struct range_index* idx, char const* base) {
+    struct index_header const* h = (struct index_header const*)base;
+    idx->header = h;
+    idx->prefix_sum = (__int128 const*)(base + sizeof(struct index_header));
+    idx->prefix_sum_sq = (unsigned __int128 const*)(idx->prefix_sum + h->blocks + 1);
+    idx->min_table = (int const*)(idx->prefix_sum_sq + h->blocks + 1);
+    idx->max_table = idx->min_table + h->levels * h->blocks;
+}
+
+/**
+ * Maps the binary number file whose values a range index covers, exiting unless
+ * it holds integers fitting an int.
+ */
+static void map_indexed_values(char const* data_filename, struct range_index* idx,
+                               struct mapped_file* mapping, size_t* out_count) {
+    map_file(data_filename, mapping);
+    if (!is_numfile(mapping))
+        exit_with_message("hw1-3: %s: range indices need a binary number file, "
+                          "create one with -c",
+                          data_filename);
+
+    idx->values = numfile_typed_values(mapping, data_filename, &idx->type, out_count);
+    struct numfile_header const* header = (struct numfile_header const*)mapping->data;
+    bool fits = idx->type == NUMFILE_INT16 || idx->type == NUMFILE_INT32 ||
+                (idx->type == NUMFILE_INT64 && (header->flags & NUMFILE_HAS_STATS) &&
+                 header->min >= INT_MIN && header->max <= INT_MAX);
+    if (!fits)
+        exit_with_message("hw1-3: %s: range indices need integers fitting an int, got %s numbers",
+                          data_filename, numfile_type_name(idx->type));
+}
+
+/**
+ * Adds the values [from, from + n) of the indexed data file to the moments,
+ * widening values other than int32 a block at a time.
+ */
+static void range_index_add_values(struct range_index const* idx, size_t from, size_t n,
+                                   struct moments* m) {
+    if (idx->type == NUMFILE_INT32) {
+        moments_add_range(m, (int const*)idx->values + from, n);
+        return;
+    }
+
+    int chunk[INDEX_BLOCK_SIZE];
+    while (n > 0) {
+        size_t k = n < INDEX_BLOCK_SIZE ? n : INDEX_BLOCK_SIZE;
+        if (idx->type == NUMFILE_INT16)
+            for (size_t i = 0; i < k; i++) chunk[i] = ((int16_t const*)idx->values)[from + i];
+        else
+            for (size_t i = 0; i < k; i++) chunk[i] = (int)((int64_t const*)idx->values)[from + i];
+        moments_add_range(m, chunk, k);
+        from += k;
+        n -= k;
+    }
+}
+
+static char* index_filename(char const* data_filename) {
+    size_t length = strlen(data_filename);
+    char* name = malloc(length + sizeof(".idx"));
+    if (!name) exit_with_message("hw1-3: out of memory");
+    memcpy(name, data_filename, length);
+    memcpy(name + length, ".idx", sizeof(".idx"));
+    return name;
+}
+
+static void stat_or_exit(char const* filename, struct stat* st) {
+    if (stat(filename, st) < 0) {
+        perror("stat");
+        exit(1);
+    }
+}
+
+/**
+ * Returns the nanoseconds of the modification time, as st_mtime only has whole seconds.
+ */
+static int64_t mtime_nsec(struct stat const* st) {
+#ifdef __APPLE__
+    return (int64_t)st->st_mtimespec.tv_nsec;
+#else
+    return (int64_t)st->st_mtim.tv_nsec;
+#endif
+}
+
+/**
+ * Builds the range index of the binary number file `data_filename`,
+ * and saves it next to it, as data_filename + ".idx".
+ */
+void build_range_index(char const* data_filename) {
+    struct range_index idx;
+    struct mapped_file data;
+    size_t count;
+    map_indexed_values(data_filename, &idx, &data, &count);
+
+    uint64_t blocks = (count + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+    uint64_t levels = 0;
+    while (((uint64_t)1 << levels) <= blocks) levels++;
+
+    size_t size = index_file_size(blocks, levels);
+    char* base = calloc(1, size);
+    if (!base) exit_with_message("hw1-3: out of memory");
+
+    struct stat st;
+    stat_or_exit(data_filename, &st);
+
+    struct index_header* h = (struct index_header*)base;
+    memcpy(h->magic, INDEX_MAGIC, sizeof(h->magic));
+    h->count = count;
+    h->block_size = INDEX_BLOCK_SIZE;
+    h->blocks = blocks;
+    h->levels = levels;
+    h->data_size = (uint64_t)st.st_size;
+    h->data_mtime = (int64_t)st.st_mtime;
+    h->data_mtime_nsec = mtime_nsec(&st);
+
+    range_index_layout(&idx, base);
+    __int128* prefix_sum = (__int128*)idx.prefix_sum;
+    unsigned __int128* prefix_sum_sq = (unsigned __int128*)idx.prefix_sum_sq;
+    int* min_table = (int*)idx.min_table;
+    int* max_table = (int*)idx.max_table;
+
+    // Per-block summaries
+    for (uint64_t b = 0; b < blocks; ++b) {
+        size_t start = b * INDEX_BLOCK_SIZE;
+        size_t n = count - start < INDEX_BLOCK_SIZE ? count - start : INDEX_BLOCK_SIZE;
+
+        struct moments m;
+        moments_init(&m);
+        range_index_add_values(&idx, start, n, &m);
+
+        prefix_sum[b + 1] = prefix_sum[b] + m.sum;
+        prefix_sum_sq[b + 1] = prefix_sum_sq[b] + m.sum_sq;
+        min_table[b] = m.min;
+        max_table[b] = m.max;
+    }
+
+    // Sparse tables, each level covering twice as many blocks as the previous one
+    for (uint64_t j = 1; j < levels; ++j) {
+        uint64_t half = (uint64_t)1 << (j - 1);
+        int const* prev_min = min_table + (j - 1) * blocks;
+        int const* prev_max = max_table + (j - 1) * blocks;
+        for (uint64_t b = 0; b + 2 * half <= blocks; ++b) {
+            int lo = prev_min[b], hi = prev_max[b];
+            if (prev_min[b + half] < lo) lo = prev_min[b + half];
+            if (prev_max[b + half] > hi) hi = prev_max[b + half];
+            min_table[j * blocks + b] = lo;
+            max_table[j * blocks + b] = hi;
+        }
+    }
+
+    // Save the index
+    char* name = index_filename(data_filename);
+    FILE* fp = fopen(name, "wb");
+    if (!fp) {
+        perror("fopen");
+        exit(1);
+    }
+    if (fwrite(base, size, 1, fp) != 1 || fclose(fp) != 0) {
+        perror("fwrite");
+        exit(1);
+    }
+
+    free(name);
+    free(base);
+    unmap_file(&data);
+}
+
+/**
+ * Maps the range index of `data_filename`, checking it matches the data file,
+ * and the values of the data file itself.
+ */
+void open_range_index(char const* data_filename, struct range_index* idx,
+                      struct mapped_file* mapping, struct mapped_file* data) {
+    char* name = index_filename(data_filename);
+    map_file(name, mapping);
+
+    struct index_header const* h = (struct index_header const*)mapping->data;
+    if (mapping->size < sizeof(struct index_header) ||
+        memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0 ||
+        h->block_size != INDEX_BLOCK_SIZE ||
+        h->blocks != (h->count + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE ||
+        mapping->size != index_file_size(h->blocks, h->levels))
+        exit_with_message("hw1-3: %s is not a valid range index, rebuild it with -i", name);
+
+    struct stat st;
+    stat_or_exit(data_filename, &st);
+    if (h->data_size != (uint64_t)st.st_size || h->data_mtime != (int64_t)st.st_mtime ||
+        h->data_mtime_nsec != mtime_nsec(&st))
+        exit_with_message("hw1-3: %s is stale, rebuild it with -i", name);
+
+    size_t count;
+    map_indexed_values(data_filename, idx, data, &count);
+    if (count != h->count) exit_with_message("hw1-3: %s is stale, rebuild it with -i", name);
+
+    range_index_layout(idx, mapping->data);
+    free(name);
+}
+
+/**
+ * Computes the statistics of nums[from, to) using the range index:
+ * whole blocks come from the prefix sums and sparse tables in O(1),
+ * and only the partial blocks at either end are scanned.
+ */
+void range_index_query(struct range_index const* idx, size_t from, size_t to,
+                       struct moments* out) {
+    moments_init(out);
+    size_t first_block = (from + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+    size_t last_block = to / INDEX_BLOCK_SIZE;
+
+    // Short ranges, not covering any whole block, are simply scanned
+    if (first_block >= last_block) {
+        range_index_add_values(idx, from, to - from, out);
+        return;
+    }
+
+    range_index_add_values(idx, from, first_block * INDEX_BLOCK_SIZE - from, out);
+    range_index_add_values(idx, last_block * INDEX_BLOCK_SIZE, to - last_block * INDEX_BLOCK_SIZE,
+                           out);
+
+    struct moments blocks = {
+        .count = (last_block - first_block) * INDEX_BLOCK_SIZE,
+        .sum = idx->prefix_sum[last_block] - idx->prefix_sum[first_block],
+        .sum_sq = idx->prefix_sum_sq[last_block] - idx->prefix_sum_sq[first_block],
+    };
+
+    unsigned level = 63 - __builtin_clzll(last_block - first_block);
+    size_t blocks_count = idx->header->blocks;
+    int const* min_row = idx->min_table + level * blocks_count;
+    int const* max_row = idx->max_table + level * blocks_count;
+    size_t second = last_block - ((size_t)1 << level);
+    blocks.min = min_row[first_block] < min_row[second] ? min_row[first_block] : min_row[second];
+    blocks.max = max_row[first_block] > max_row[second] ? max_row[first_block] : max_row[second];
+
+    moments_merge(out, &blocks);
+}
+
+/**
+ * Answers a batch of range queries, read from `queries` (or stdin, if it's "-")
+ * as pairs of whitespace-separated offsets `from to`, each standing for the half-open
+ * range [from, to) of the data file. The index and the data file are only mapped.
+ */
+void answer_range_queries(char const* data_filename, char const* queries_filename) {
+    double open_begin = now_in_sec();
+    struct range_index idx;
+    struct mapped_file mapping, data;
+    open_range_index(data_filename, &idx, &mapping, &data);
+    size_t count = idx.header->count;
+    double open_elapsed = now_in_sec() - open_begin;
+
+    int fd = STDIN_FILENO;
+    if (strcmp(queries_filename, "-") != 0) {
+        fd = open(queries_filename, O_RDONLY);
+        if (fd < 0) {
+            perror("open");
+            exit(1);
+        }
+    }
+
+    struct number_stream s = {.fd = fd, .buffer = malloc(STREAM_CHUNK_SIZE)};
+    if (!s.buffer) exit_with_message("hw1-3: out of memory");
+
+    puts("#from\tto\t#data\tmin\tmax\tmean\tvariance");
+
+    size_t queries = 0;
+    double elapsed = 0.0;
+    size_t start, length;
+    while ((length = number_stream_next_token(&s, &start)) > 0) {
+        size_t from = (size_t)parse_token(s.buffer + start, length, 0, LLONG_MAX,
+                                          s.offset + start);
+        if ((length = number_stream_next_token(&s, &start)) == 0)
+            exit_with_message("hw1-3: query %zu is missing its end", queries + 1);
+        size_t to = (size_t)parse_token(s.buffer + start, length, 0, LLONG_MAX,
+                                        s.offset + start);
+        if (from >= to || to > count)
+            exit_with_message("hw1-3: query %zu: invalid range [%zu, %zu) of %zu numbers",
+                              queries + 1, from, to, count);
+
+        double begin = now_in_sec();
+        struct moments m;
+        range_index_query(&idx, from, to, &m);
+        elapsed += now_in_sec() - begin;
+        queries++;
+
+        printf("%zu\t%zu\t%zu\t%d\t%d\t%.1f\t%.1f\n", from, to, m.count, m.min, m.max,
+               moments_mean(&m), moments_variance(&m));
+    }
+
+    if (queries)
+        fprintf(stderr,
+                "answered %zu queries in %.1f us (%.2f us/query), after opening the index "
+                "in %.1f us\n",
+                queries, elapsed * 1e6, elapsed * 1e6 / (double)queries, open_elapsed * 1e6);
+
+    if (fd != STDIN_FILENO) close(fd);
+    free(s.buffer);
+    unmap_file(&mapping);
+    unmap_file(&data);
+}
+
+void print_statistics(size_t count, int min, int max, double mean, double variance) {
+    puts("#data\tmin\tmax\tmean\tvariance");
+    printf("%zu\t%d\t%d\t%.1f\t%.1f\n", count, min, max, mean, variance);
+}
+
+void print_summary(struct summary const* s) {
+    struct moments const* m = &s->moments;
+    print_statistics(m->count, m->min, m->max, moments_mean(m), moments_variance(m));
+}
+
+/**
+ * Maximum number of percentiles that can be requested with -q.
+ */
+#define MAX_PERCENTILES 32
+
+/**
+ * Candidate sets at most this large are sorted outright by exact selection.
+ */
+#define SELECT_SORT_SIZE 64
+
+static void insertion_sort_ints(int* x, size_t n) {
+    for (size_t i = 1; i < n; ++i) {
+        int v = x[i];
+        size_t j = i;
+        for (; j > 0 && x[j - 1] > v; --j) x[j] = x[j - 1];
+        x[j] = v;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+#define AVX2_INLINE __attribute__((target("avx2"), always_inline)) static inline
+
+/**
+ * Compare-exchange of two vectors: afterwards every lane of *a is <= the same lane of *b.
+ */
+AVX2_INLINE void cmpxchg_avx2(__m256i* a, __m256i* b) {
+    __m256i lo = _mm256_min_epi32(*a, *b);
+    *b = _mm256_max_epi32(*a, *b);
+    *a = lo;
+}
+
+/**
+ * Sorts a bitonic sequence within a single vector.
+ */
+AVX2_INLINE __m256i bitonic_clean_avx2(__m256i v) {
+    __m256i s = _mm256_permute2x128_si256(v, v, 0x01);  // lanes 4 apart
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, s), _mm256_max_epi32(v, s), 0xF0);
+    s = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));  // lanes 2 apart
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, s), _mm256_max_epi32(v, s), 0xCC);
+    s = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));  // adjacent lanes
+    return _mm256_blend_epi32(_mm256_min_epi32(v, s), _mm256_max_epi32(v, s), 0xAA);
+}
+
+/**
+ * Merges two sorted runs of `half` vectors each, r[0, half) and r[half, 2 * half),
+ * with a bitonic merge: the second run is reversed, which makes the whole sequence bitonic.
+ */
+AVX2_INLINE void bitonic_merge_avx2(__m256i* r, size_t half) {
+    __m256i const reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    for (size_t i = 0; i < half / 2; ++i) {
+        __m256i t = r[half + i];
+        r[half + i] = r[2 * half - 1 - i];
+        r[2 * half - 1 - i] = t;
+    }
+    for (size_t i = half; i < 2 * half; ++i) r[i] = _mm256_permutevar8x32_epi32(r[i], reverse);
+
+    for (size_t stride = half; stride > 0; stride /= 2) {
+        for (size_t i = 0; i < 2 * half; ++i) {
+            if (!(i & stride)) cmpxchg_avx2(r + i, r + i + stride);
+        }
+    }
+    for (size_t i = 0; i < 2 * half; ++i) r[i] = bitonic_clean_avx2(r[i]);
+}
+
+/**
+ * Sorts up to 64 ints in registers: an optimal 19-comparator network sorts the 8 columns
+ * of an 8x8 matrix, its transposition gives 8 sorted vectors, and three rounds
+ * of bitonic merges combine them.
+ */
+__attribute__((target("avx2"))) static void sort_small_avx2(int* x, size_t n) {
+    assert(n <= 64);
+    int padded[64];
+    for (size_t i = 0; i < 64; ++i) padded[i] = i < n ? x[i] : INT_MAX;
+
+    __m256i r[8];
+    for (size_t i = 0; i < 8; ++i) r[i] = _mm256_loadu_si256((__m256i const*)(padded + 8 * i));
+
+    static unsigned char const network[19][2] = {
+        {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}, {0, 1}, {2, 3},
+        {4, 5}, {6, 7}, {2, 4}, {3, 5}, {1, 4}, {3, 6}, {1, 2}, {3, 4}, {5, 6},
+    };
+    for (size_t i = 0; i < 19; ++i) cmpxchg_avx2(r + network[i][0], r + network[i][1]);
+
+    // Transpose, so that every vector holds one sorted column
+    __m256i t[8];
+    for (size_t i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (size_t i = 0; i < 8; i += 4) {
+        r[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        r[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        r[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        r[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        t[i] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x20);
+        t[i + 4] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x31);
+    }
+
+    for (size_t half = 1; half < 8; half *= 2) {
+        for (size_t i = 0; i < 8; i += 2 * half) bitonic_merge_avx2(t + i, half);
+    }
+
+    for (size_t i = 0; i < 8; ++i) _mm256_storeu_si256((__m256i*)(padded + 8 * i), t[i]);
+    for (size_t i = 0; i < n; ++i) x[i] = padded[i];
+}
+
+#endif  // HAVE_X86_SIMD
+
+/**
+ * Sorts at most SELECT_SORT_SIZE ints.
+ */
+static void sort_small(int* x, size_t n) {
+    static void (*impl)(int*, size_t) = NULL;
+    if (!impl) {
+        impl = insertion_sort_ints;
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) impl = sort_small_avx2;
+#endif
+    }
+    impl(x, n);
+}
+
+/**
+ * Finds the values of the given 0-based ranks (in ascending order) among x[0, n),
+ * whose keys (the values with the sign bit flipped, so that they order as unsigned ints)
+ * all agree above bit `shift + 8`.
+ *
+ * This is an MSD radix selection: a histogram of the next 8 bits of the keys locates
+ * the bucket of every rank, and a single pass gathers the values of just those buckets,
+ * which are then searched recursively. Each level shrinks the candidates about 256 times,
+ * so a few passes over the input are enough, without ever sorting it.
+ */
+static void radix_select(int const* x, size_t n, int shift, size_t const* ranks, size_t count,
+                         int* out) {
+    if (n <= SELECT_SORT_SIZE || shift < 0) {
+        int sorted[SELECT_SORT_SIZE];
+        if (n > SELECT_SORT_SIZE) {  // all keys are equal
+            for (size_t i = 0; i < count; ++i) out[i] = x[0];
+            return;
+        }
+
+        for (size_t i = 0; i < n; ++i) sorted[i] = x[i];
+        sort_small(sorted, n);
+        for (size_t i = 0; i < count; ++i) out[i] = sorted[ranks[i]];
+        return;
+    }
+
+    size_t histogram[256] = {0};
+    for (size_t i = 0; i < n; ++i) histogram[(((unsigned)x[i] ^ 0x80000000u) >> shift) & 0xFF]++;
+
+    // Skip the gathering pass if all values fall into the same bucket
+    unsigned first_bucket = (((unsigned)x[0] ^ 0x80000000u) >> shift) & 0xFF;
+    if (histogram[first_bucket] == n) {
+        radix_select(x, n, shift - 8, ranks, count, out);
+        return;
+    }
+
+    // Find the bucket of every rank, and where its values start
+    size_t starts[257];
+    starts[0] = 0;
+    for (unsigned b = 0; b < 256; ++b) starts[b + 1] = starts[b] + histogram[b];
+
+    bool wanted[256] = {false};
+    for (size_t i = 0, b = 0; i < count; ++i) {
+        while (starts[b + 1] <= ranks[i]) b++;
+        wanted[b] = true;
+    }
+
+    size_t needed = 0;
+    for (unsigned b = 0; b < 256; ++b) needed += wanted[b] ? histogram[b] : 0;
+    int* buffer = malloc(needed * sizeof(int));
+    if (!buffer) exit_with_message("hw1-3: out of memory");
+
+    int* gathered[256] = {NULL};
+    int* cursor[256] = {NULL};
+    for (size_t b = 0, offset = 0; b < 256; ++b) {
+        if (!wanted[b]) continue;
+        gathered[b] = cursor[b] = buffer + offset;
+        offset += histogram[b];
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        unsigned b = (((unsigned)x[i] ^ 0x80000000u) >> shift) & 0xFF;
+        if (cursor[b]) *cursor[b]++ = x[i];
+    }
+
+    // Recurse into every bucket, with the ranks falling into it
+    size_t local_ranks[MAX_PERCENTILES];
+    for (size_t i = 0; i < count;) {
+        size_t b = 0;
+        while (starts[b + 1] <= ranks[i]) b++;
+
+        size_t j = i;
+        for (; j < count && ranks[j] < starts[b + 1]; ++j)
+            local_ranks[j - i] = ranks[j] - starts[b];
+        radix_select(gathered[b], histogram[b], shift - 8, local_ranks, j - i, out + i);
+        i = j;
+    }
+
+    free(buffer);
+}
+
+/**
+ * Computes the exact percentiles (in ascending order) of the numbers, using nearest ranks,
+ * like kll_quantiles.
+ */
+void exact_percentiles(int const* nums, size_t n, double const* percentiles, size_t count,
+                       int* out) {
+    assert(count <= MAX_PERCENTILES);
+    if (n == 0) return;
+
+    size_t ranks[MAX_PERCENTILES];
+    for (size_t i = 0; i < count; ++i) {
+        // The smallest value with at least percentile% of all values at or below it
+        double rank = percentiles[i] / 100.0 * (double)n;
+        size_t r = (size_t)rank;
+        if ((double)r < rank) r++;
+        ranks[i] = r == 0 ? 0 : r > n ? n - 1 : r - 1;
+    }
+    radix_select(nums, n, 24, ranks, count, out);
+}
+
+/**
+ * Parses a comma-separated list of percentiles, like "50,90,99.9".
+ * Returns the number of percentiles, sorted in increasing order.
+ */
+size_t parse_percentiles(char const* list, double* out) {
+    size_t count = 0;
+    char const* p = list;
+    char* end;
+    do {
+        if (count == MAX_PERCENTILES) exit_with_message("hw1-3: too many percentiles");
+        double percentile = strtod(p, &end);
+        if (end == p || percentile < 0.0 || percentile > 100.0 || (*end && *end != ','))
+            exit_with_message("hw1-3: invalid percentile list \"%s\"", list);
+        out[count++] = percentile;
+        p = end + 1;
+    } while (*end);
+
+    qsort(out, count, sizeof(double), compare_doubles);
+    return count;
+}
+
+void print_quantiles(struct summary const* s, double const* percentiles, size_t count) {
+    double qs[MAX_PERCENTILES] = {0}, values[MAX_PERCENTILES] = {0};
+    for (size_t i = 0; i < count; ++i) qs[i] = percentiles[i] / 100.0;
+    kll_quantiles(s->quantiles, qs, count, values);
+
+    printf("#percentile\tvalue\t(KLL k=%u, rank error +/-%.2f%%)\n", s->quantiles->k,
+           kll_rank_error(s->quantiles->k) * 100.0);
+    for (size_t i = 0; i < count; ++i) {
+        // The extremes are known exactly
+        if (s->moments.count && percentiles[i] == 0.0) values[i] = s->moments.min;
+        if (s->moments.count && percentiles[i] == 100.0) values[i] = s->moments.max;
+        printf("p%g\t%.0f\n", percentiles[i], values[i]);
+    }
+}
+
+void print_distinct(struct summary const* s) {
+    printf("#distinct\t(HLL p=%u, standard error +/-%.2f%%)\n", s->distinct->precision,
+           hll_error(s->distinct->precision) * 100.0);
+    printf("%.0f\n", s->moments.count ? hll_estimate(s->distinct) : 0.0);
+}
+
+/**
+ * Prints the monitored values, most frequent first.
+ * Their true counts lie between the lower bound and the count.
+ */
+void print_heavy_hitters(struct summary const* s) {
+    struct heavy_sketch const* h = s->heavy;
+    struct heavy_counter* counters = malloc((h->size + 1) * sizeof(struct heavy_counter));
+    if (!counters) exit_with_message("hw1-3: out of memory");
+    memcpy(counters, h->heap, h->size * sizeof(struct heavy_counter));
+    qsort(counters, h->size, sizeof(struct heavy_counter), compare_counters);
+
+    printf("#value\tcount\tlower bound\t(SpaceSaving k=%u, overestimate <= %llu)\n", h->k,
+           (unsigned long long)(h->n / h->k));
+    for (unsigned i = 0; i < h->size; ++i) {
+        printf("%d\t%llu\t%llu\n", counters[i].value, (unsigned long long)counters[i].count,
+               (unsigned long long)(counters[i].count - counters[i].error));
+    }
+
+    free(counters);
+}
+
+/**
+ * Prints the optional sketches of the summary, apart from the quantiles.
+ */
+void print_sketches(struct summary const* s) {
+    if (s->distinct) print_distinct(s);
+    if (s->heavy) print_heavy_hitters(s);
+}
+
+/**
+ * Prints the exact percentiles of the numbers, in the format of print_quantiles.
+ */
+void print_exact_percentiles(int const* nums, size_t n, double const* percentiles,
+                             size_t count) {
+    int values[MAX_PERCENTILES] = {0};
+    exact_percentiles(nums, n, percentiles, count, values);
+
+    puts("#percentile\tvalue\t(exact)");
+    for (size_t i = 0; i < count; ++i) {
+        if (n)
+            printf("p%g\t%d\n", percentiles[i], values[i]);
+        else
+            printf("p%g\tnan\n", percentiles[i]);
+    }
+}
+
+/**
+ * A list of input files, growing as needed.
+ */
+struct file_list {
+    char** names;
+    size_t count;
+    size_t capacity;
+};
+
+static void file_list_push(struct file_list* list, char* name) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->names = realloc(list->names, list->capacity * sizeof(char*));
+        if (!list->names) exit_with_message("hw1-3: out of memory");
+    }
+    list->names[list->count++] = name;
+}
+
+static int compare_strings(void const* a, void const* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * Adds `path` to the list, or all regular files in it, sorted by name, if it's a directory.
+ * Hidden files and range indices (.idx) in directories are skipped.
+ */
+void file_list_add(struct file_list* list, char const* path) {
+    struct stat st;
+    stat_or_exit(path, &st);
+
+    if (!S_ISDIR(st.st_mode)) {
+        char* name = strdup(path);
+        if (!name) exit_with_message("hw1-3: out of memory");
+        file_list_push(list, name);
+        return;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir) {
+        perror("opendir");
+        exit(1);
+    }
+
+    size_t first = list->count;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        size_t length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.') continue;
+        if (length >= 4 && strcmp(entry->d_name + length - 4, ".idx") == 0) continue;
+
+        size_t path_length = strlen(path);
+        char* name = malloc(path_length + length + 2);
+        if (!name) exit_with_message("hw1-3: out of memory");
+        memcpy(name, path, path_length);
+        name[path_length] = '/';
+        memcpy(name + path_length + 1, entry->d_name, length + 1);
+
+        if (stat(name, &st) == 0 && S_ISREG(st.st_mode))
+            file_list_push(list, name);
+        else
+            free(name);
+    }
+    closedir(dir);
+
+    qsort(list->names + first, list->count - first, sizeof(char*), compare_strings);
+}
+
+void file_list_free(struct file_list* list) {
+    for (size_t i = 0; i < list->count; ++i) free(list->names[i]);
+    free(list->names);
+}
+
+/**
+ * Work shared by the batch workers: files are handed out one at a time,
+ * so that a few large files don't leave the other workers idle.
+ */
+struct batch {
+    struct file_list const* files;
+    struct summary_options const* options;
+    struct moments* results;  // moments of every file
+
+    pthread_mutex_t lock;
+    size_t next;  // index of the next file to process
+};
+
+/**
+ * A single batch worker, with the merged summary of all files it has processed.
+ */
+struct batch_worker {
+    pthread_t thread;
+    struct batch* batch;
+    struct summary total;
+};
+
+static void* batch_worker(void* arg) {
+    struct batch_worker* worker = arg;
+    struct batch* batch = worker->batch;
+
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        size_t i = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+        if (i >= batch->files->count) break;
+
+        char const* name = batch->files->names[i];
+        struct summary s;
+        summary_init(&s, batch->options, i + 1);
+
+        // Packed files are summarized block by block, others are loaded in full
+        struct mapped_file mapping;
+        map_file(name, &mapping);
+        if (is_packed_file(&mapping)) {
+            struct packed_file f;
+            open_packed_file(&mapping, name, &f);
+            packed_add_blocks(&f, name, 0, f.header->blocks, &s);
+            unmap_file(&mapping);
+        } else {
+            unmap_file(&mapping);
+            size_t count;
+            int* nums;
+            load_numbers_mmap(name, &count, &nums, &mapping);
+            summary_add_range(&s, nums, count);
+            free_numbers(nums, &mapping);
+        }
+
+        batch->results[i] = s.moments;
+        summary_merge(&worker->total, &s);
+        summary_free(&s);
+    }
+
+    return NULL;
+}
+
+/**
+ * Computes the statistics of every file on `threads` workers and prints them in order.
+ * The summary of all files together is merged from the per-file summaries into `out`,
+ * without reading any file twice.
+ */
+void batch_statistics(struct file_list const* files, unsigned threads,
+                      struct summary_options const* options, struct summary* out) {
+    if (threads > files->count) threads = files->count;
+    if (threads == 0) threads = 1;
+
+    struct batch batch = {
+        .files = files,
+        .options = options,
+        .results = calloc(files->count, sizeof(struct moments)),
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+    };
+    struct batch_worker* workers = calloc(threads, sizeof(struct batch_worker));
+    if (!batch.results || !workers) exit_with_message("hw1-3: out of memory");
+
+    // Make sure the kernel, tokenizer and decoder are picked before the workers race to do so
+    summary_init(out, options, 0);
+    moments_add_range(&out->moments, NULL, 0);
+    char const* empty = "";
+    parse_numbers(&empty, empty, empty, NULL, 0);
+    packed_decoder();
+
+    for (unsigned t = 0; t < threads; ++t) {
+        workers[t].batch = &batch;
+        summary_init(&workers[t].total, options, files->count + t + 1);
+        if (t == 0) continue;  // the main thread is a worker too
+
+        int err = pthread_create(&workers[t].thread, NULL, batch_worker, workers + t);
+        if (err) exit_with_message("hw1-3: pthread_create: %s", strerror(err));
+    }
+
+    batch_worker(workers);
+    for (unsigned t = 0; t < threads; ++t) {
+        if (t > 0) pthread_join(workers[t].thread, NULL);
+        summary_merge(out, &workers[t].total);
+        summary_free(&workers[t].total);
+    }
+
+    puts("#file\t#data\tmin\tmax\tmean\tvariance");
+    for (size_t i = 0; i < files->count; ++i) {
+        struct moments const* m = batch.results + i;
+        printf("%s\t%zu\t%d\t%d\t%.1f\t%.1f\n", files->names[i], m->count, m->min, m->max,
+               moments_mean(m), moments_variance(m));
+    }
+
+    free(workers);
+    free(batch.results);
+    pthread_mutex_destroy(&batch.lock);
+}
+
+noreturn void print_usage_and_exit(void) {
+    fputs(
+        "Usage: ./hw1-3 [-b] [-r] [-t threads] [-q percentiles [-k size | -x]] [-d precision]\n"
+        "               [-H counters] filename\n"
+        "       ./hw1-3 -s [-q percentiles [-k size]] [-d precision] [-H counters] [filename]\n"
+        "       ./hw1-3 -c output.bin filename\n"
+        "       ./hw1-3 -z output.svb filename\n"
+        "       ./hw1-3 (-w count | -T seconds) [-e every] [filename]\n"
+        "       ./hw1-3 -i filename\n"
+        "       ./hw1-3 -Q queries filename\n"
+        "       ./hw1-3 -m [-t threads] [-q percentiles [-k size]] [-d precision] [-H counters]\n"
+        "               (filename | directory)...\n"
+        "\n"
+        "filename may be a text file (count followed by numbers),\n"
+        "a binary number file created with -c or a packed file created with -z.\n"
+        "Plain statistics and -c pick the narrowest of int16, int32, int64, float and double\n"
+        "able to hold the input; all other modes need integers fitting an int,\n"
+        "which they read from a binary number file of any element type.\n"
+        "\n"
+        "  -b  benchmark the fscanf and mmap loaders, and the summation kernels\n"
+        "  -c  convert the input to a binary number file of its narrowest element type\n"
+        "  -d  estimate the number of distinct values with a HyperLogLog sketch\n"
+        "      of 2^precision registers (precision 4..18; standard error 1.04 / 2^(precision/2))\n"
+        "  -e  with -w or -T, print the window statistics every that many values\n"
+        "      (default: the window size with -w, every value otherwise)\n"
+        "  -H  estimate the most frequent values with that many SpaceSaving counters;\n"
+        "      counts are overestimated by at most #data / counters\n"
+        "  -i  build a range index of a binary number file of integers, saved as filename.idx\n"
+        "  -k  quantile sketch size, trading memory for accuracy (default: 200)\n"
+        "  -m  batch mode: print the statistics of every file (or every file in a directory),\n"
+        "      then the statistics of all of them together\n"
+        "  -q  comma-separated percentiles to estimate, like 50,90,99\n"
+        "  -Q  answer the range queries (pairs of offsets \"from to\") from the queries file\n"
+        "      (or stdin if \"-\"), using the range index built with -i\n"
+        "  -r  use the reference fscanf loader and four-pass scalar kernels (text only)\n"
+        "  -s  stream a text file using constant memory,\n"
+        "      reading from stdin if filename is missing or \"-\";\n"
+        "      with more than one thread, reading and parsing are pipelined\n"
+        "  -t  number of worker threads (default: number of CPUs)\n"
+        "  -T  sliding window over the values from the last that many seconds\n"
+        "  -w  sliding window over the last that many values;\n"
+        "      windows read an unbounded stream without the count header,\n"
+        "      from stdin if filename is missing or \"-\"\n"
+        "  -x  compute the -q percentiles exactly, instead of estimating them\n"
+        "  -z  compress the input to a packed file (delta + Stream-VByte coded ints),\n"
+        "      which is decoded block by block straight into the statistics\n",
+        stderr);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    // Check the arguments
+    bool streaming = false;
+    bool reference = false;
+    bool benchmark = false;
+    char const* convert_to = NULL;
+    char const* compress_to = NULL;
+    struct summary_options options = {0};
+    unsigned quantile_k = 200;
+    double percentiles[MAX_PERCENTILES];
+    size_t percentiles_count = 0;
+    unsigned threads = default_thread_count();
+    size_t window_count = 0;
+    double window_age = 0.0;
+    size_t window_every = 0;
+    bool build_index = false;
+    char const* queries = NULL;
+    bool batch = false;
+    bool exact = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "bc:d:e:H:ik:mq:Q:rst:T:w:xz:")) != -1) {
+        switch (opt) {
+            case 'b':
+                benchmark = true;
+                break;
+            case 'c':
+                convert_to = optarg;
+                break;
+            case 'd':
+                options.hll_precision = (unsigned)atoi(optarg);
+                if (options.hll_precision < HLL_MIN_PRECISION ||
+                    options.hll_precision > HLL_MAX_PRECISION)
+                    print_usage_and_exit();
+                break;
+            case 'e':
+                window_every = (size_t)atoll(optarg);
+                if (window_every == 0) print_usage_and_exit();
+                break;
+            case 'H':
+                options.heavy_k = (unsigned)atoi(optarg);
+                if (options.heavy_k == 0) print_usage_and_exit();
+                break;
+            case 'i':
+                build_index = true;
+                break;
+            case 'k':
+                quantile_k = (unsigned)atoi(optarg);
+                if (quantile_k < KLL_MIN_CAPACITY) print_usage_and_exit();
+                break;
+            case 'm':
+                batch = true;
+                break;
+            case 'q':
+                percentiles_count = parse_percentiles(optarg, percentiles);
+                break;
+            case 'Q':
+                queries = optarg;
+                break;
+            case 'r':
+                reference = true;
+                break;
+            case 's':
+                streaming = true;
+                break;
+            case 't':
+                threads = (unsigned)atoi(optarg);
+                if (threads == 0) print_usage_and_exit();
+                break;
+            case 'T':
+                window_age = atof(optarg);
+                if (window_age <= 0.0) print_usage_and_exit();
+                break;
+            case 'w':
+                window_count = (size_t)atoll(optarg);
+                if (window_count == 0) print_usage_and_exit();
+                break;
+            case 'x':
+                exact = true;
+                break;
+            case 'z':
+                compress_to = optarg;
+                break;
+            default:
+                print_usage_and_exit();
+        }
+    }
+
+    bool windowed = window_count || window_age > 0.0;
+    if (exact && !percentiles_count) print_usage_and_exit();
+    if (exact && (batch || streaming))
+        exit_with_message("hw1-3: -x needs a single, fully loaded input");
+    if (percentiles_count && !exact) options.quantile_k = quantile_k;
+
+    // Batch mode over many files
+    if (batch) {
+        if (optind == argc) print_usage_and_exit();
+        struct file_list files = {0};
+        for (int i = optind; i < argc; ++i) file_list_add(&files, argv[i]);
+
+        struct summary s;
+        batch_statistics(&files, threads, &options, &s);
+        struct moments const* m = &s.moments;
+        printf("total\t%zu\t%d\t%d\t%.1f\t%.1f\n", m->count, m->min, m->max, moments_mean(m),
+               moments_variance(m));
+        if (s.quantiles) print_quantiles(&s, percentiles, percentiles_count);
+        print_sketches(&s);
+
+        summary_free(&s);
+        file_list_free(&files);
+        return 0;
+    }
+
+    char const* filename = optind < argc ? argv[optind] : NULL;
+    if (argc - optind > 1 || (!streaming && !windowed && !filename)) print_usage_and_exit();
+
+    // Stream input comes from stdin, unless a file is provided
+    int fd = STDIN_FILENO;
+    if ((streaming || windowed) && filename && strcmp(filename, "-") != 0) {
+        fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+            perror("open");
+            exit(1);
+        }
+    }
+
+    // Sliding windows over an unbounded stream
+    if (windowed) {
+        if (percentiles_count || options.hll_precision || options.heavy_k)
+            exit_with_message("hw1-3: -q, -d and -H are not supported with windows");
+        if (!window_every) window_every = window_count ? window_count : 1;
+        window_statistics(fd, window_count, window_age, window_every);
+        if (fd != STDIN_FILENO) close(fd);
+        return 0;
+    }
+
+    // Streaming mode - never load the whole file
+    if (streaming) {
+        struct summary s;
+        if (threads > 1)
+            pipeline_statistics(fd, threads, &options, &s);
+        else
+            stream_statistics(fd, &options, &s);
+        if (fd != STDIN_FILENO) close(fd);
+
+        print_summary(&s);
+        if (s.quantiles) print_quantiles(&s, percentiles, percentiles_count);
+        print_sketches(&s);
+        summary_free(&s);
+        return 0;
+    }
+
+    // Plain statistics and conversions use the narrowest element type of the input
+    bool sketches = percentiles_count || options.hll_precision || options.heavy_k;
+    bool plain = !reference && !benchmark && !build_index && !queries && !sketches && !compress_to;
+
+    // Packed files are decoded block by block, straight into the summary
+    if (!reference && !benchmark && !build_index && !queries && !exact && !convert_to &&
+        !compress_to) {
+        struct mapped_file mapping;
+        map_file(filename, &mapping);
+        if (is_packed_file(&mapping)) {
+            struct summary s;
+            packed_statistics(&mapping, filename, threads, &options, &s);
+            unmap_file(&mapping);
+
+            print_summary(&s);
+            if (s.quantiles) print_quantiles(&s, percentiles, percentiles_count);
+            print_sketches(&s);
+            summary_free(&s);
+            return 0;
+        }
+        unmap_file(&mapping);
+    }
+
+    if (convert_to || plain) {
+        struct typed_numbers typed;
+        load_typed_numbers(filename, &typed);
+
+        struct typed_stats s;
+        typed_statistics(&typed, threads, &s);
+        if (typed.mapping.data) check_numfile_stats(&typed.mapping, filename, &s);
+        if (convert_to)
+            write_numfile(convert_to, &typed, &s);
+        else
+            print_typed_statistics(typed.type, &s);
+
+        free_typed_numbers(&typed);
+        return 0;
+    }
+
+    // Range indices only map the data file, which is never loaded
+    if (build_index && !benchmark) {
+        build_range_index(filename);
+        return 0;
+    }
+    if (queries && !benchmark) {
+        answer_range_queries(filename, queries);
+        return 0;
+    }
+
+    if (benchmark) benchmark_loaders(filename);
+
+    // Load the numbers
+    size_t nums_count = 0;
+    int* nums = NULL;
+    struct mapped_file mapping = {0};
+    if (reference)
+        load_numbers(filename, &nums_count, &nums);
+    else
+        load_numbers_mmap(filename, &nums_count, &nums, &mapping);
+
+    if (benchmark) benchmark_summation(nums_count, nums);
+
+    // Find the requested numeric data
+    if (build_index) {
+        build_range_index(filename);
+    } else if (compress_to) {
+        write_packed_file(compress_to, nums, nums_count);
+    } else if (queries) {
+        answer_range_queries(filename, queries);
+    } else if (reference) {
+        int min = find_min(nums_count, nums);
+        int max = find_max(nums_count, nums);
+        double mean = find_mean(nums_count, nums);
+        double variance = find_variance(nums_count, nums, mean);
+        print_statistics(nums_count, min, max, mean, variance);
+    } else {
+        struct summary s;
+        reduce_numbers(nums, nums_count, threads, &options, &s);
+        print_summary(&s);
+        if (exact) print_exact_percentiles(nums, nums_count, percentiles, percentiles_count);
+        if (s.quantiles) print_quantiles(&s, percentiles, percentiles_count);
+        print_sketches(&s);
+        summary_free(&s);
+    }
 
     // Free the allocated vector of numbers
-    free(nums);
+    free_numbers(nums, &mapping);
 
     return 0;
 }
@@ -18,8 +18,11 @@
 
 #include<stdio.h>
 #include<stdlib.h>
+#include<stdbool.h>
 #include<string.h>	// string library
 #include<time.h>	// time library
+#include<pthread.h>	// threads of the sample sort
+#include<unistd.h>	// sysconf
 
 // TIME
 // THE FOLLOWING FUNCTIONS SHOW HOW TO MEASURE THE EXECUTION TIME
@@ -86,6 +89,18 @@ char *strdup_c(const char *s) {
   return strdup(s);
 }
 
+// COMPARISONS
+// when compiled with -DCOUNT_COMPARISONS, every comparison of two words
+// (compare_SUFFIX and lcp_from_SUFFIX below) is counted, and the total
+// is displayed after the memory usage. The counter is shared by the threads
+// of the sample sort. Radix sorts (methods 4 and 5) mostly read single
+// characters instead, which are not counted.
+#ifdef COUNT_COMPARISONS
+static unsigned long long comparisons = 0;
+#define COUNT_COMPARISON() __atomic_fetch_add(&comparisons, 1, __ATOMIC_RELAXED)
+#else
+#define COUNT_COMPARISON() ((void)0)
+#endif
 
 // DO NOT USE malloc() and strdup()
 // the below two lines detects unallowed usage of malloc and strdup
@@ -113,32 +128,46 @@ void print_chararr( FILE *fp, char *A[], int N )
   fprintf(fp,"\n");
 }
 
-void free_chararr( char **A, int N )
-  // A: char string array to free
-  // N:   size of the array
+// prints the array from the last word to the first one,
+// in the format of print_chararr
+void print_chararr_reversed( FILE *fp, char *A[], int N )
 {
   int i;
-  for (i=0; i<N; i++) free(A[i]);
+  fprintf(fp,"%d\n",N);
+  for (i=N-1; i>=0; i--) fprintf(fp,"%s ",A[i]);
+  fprintf(fp,"\n");
+}
+
+void free_chararr( char **A, char *arena )
+  // A: char string array to free
+  // arena: memory holding all of its words, returned by read_chararr_textfile
+{
+  free(arena);
   free(A);
 }
 
 /////////////////////////////////////////////////////////////
 // read words from a text file
-// NOTE: using malloc_c() and strdup_c()
+// NOTE: using malloc_c()
+// all words are stored one after another in a single arena,
+// instead of a separate strdup_c() allocation for every word
 /////////////////////////////////////////////////////////////
 
 // maximum length of a single string (word)
 #define MAX_WORD_LEN	256
 
-char **read_chararr_textfile( const char infile[], int *pN )
+char **read_chararr_textfile( const char infile[], int *pN, char **pArena )
   // returns an array of words, with its size stored in
-  // the memory indicated by integer pointer variable pN
-  // the retured memory should freed by the caller
+  // the memory indicated by integer pointer variable pN,
+  // and the arena holding the words in the memory indicated by pArena
+  // the retured memory should freed by the caller, using free_chararr
 {
   int i;
   FILE *fp;
   char buf[MAX_WORD_LEN];	// temporary string for fscanf
   char **A;
+  char *next;	// where the next word goes in the arena
+  long file_size;
 
   // NOTE: a lot of part of the code below are file I/O error checking
   // simple code (without error checking)
@@ -154,6 +183,8 @@ char **read_chararr_textfile( const char infile[], int *pN )
   return A;
   */
 
+  *pArena = NULL;
+
   // check for input file name
   if ( infile == NULL ) {
     fprintf(stderr, "NULL file name\n");
@@ -167,6 +198,12 @@ char **read_chararr_textfile( const char infile[], int *pN )
     return NULL;
   }
   else {
+    // every word is followed by a whitespace or the end of the file,
+    // so the words with their null characters take at most file size + 1 bytes
+    fseek(fp, 0, SEEK_END);
+    file_size = ftell(fp);
+    rewind(fp);
+
     // check for number of elements
     if ( fscanf(fp, "%d", pN) != 1 || *pN <= 0 ) {
       fprintf(stderr, "cannot read number of elements %s\n",infile);
@@ -174,6 +211,8 @@ char **read_chararr_textfile( const char infile[], int *pN )
     }
     else {
       A = (char**)malloc_c(sizeof(char*)*(*pN));
+      *pArena = (char*)malloc_c(file_size+1);
+      next = *pArena;
       for (i=0; i<(*pN); i++) {
 	if ( fscanf(fp, "%s", buf) != 1 ) {
 	  fprintf(stderr, "cannot read value at %d/%d\n",i+1,(*pN));
@@ -182,7 +221,10 @@ char **read_chararr_textfile( const char infile[], int *pN )
 	  return A;
 	}
 	else {
-	  A[i] = strdup_c(buf);	// copy the word stored in buf
+	  // copy the word stored in buf to the arena
+	  strcpy(next, buf);
+	  A[i] = next;
+	  next += strlen(buf)+1;
 	}
       }
       fclose(fp);
@@ -228,21 +270,56 @@ void write_chararr_textfile( const char outfile[],
 }
 
 /////////////////////////////////////////////////////////////
-// bubble sort
-// source: https://ko.wikipedia.org/
+// write words to a text file in reverse order
+// streams A backwards, instead of writing a reversed copy of it
 /////////////////////////////////////////////////////////////
-void bubble_sort_chararr(char **arr, int n) {
-  // moving array pointers
-  int i, j;
-  char *temp;
-  for (i=n-1; i>0; i--) {
-    for (j=0; j<i; j++) {
-      if (strcmp(arr[j], arr[j+1]) > 0 ) {
-	temp = arr[j];
-	arr[j] = arr[j+1];
-	arr[j+1] = temp;
-      }
-    }
+void write_chararr_textfile_reversed( const char outfile[],
+    char *A[], int N )
+{
+  FILE *fp;
+
+  // check for output filename
+  if ( outfile == NULL ) {
+    fprintf(stderr, "NULL file name\n");
+    return;
+  }
+
+  // check for file existence
+  fp = fopen(outfile,"w");
+  if ( !fp ) {
+    fprintf(stderr, "cannot open file for write %s\n",outfile);
+  }
+  else {
+    print_chararr_reversed(fp,A,N);
+    fclose(fp);
+  }
+}
+
+/////////////////////////////////////////////////////////////
+// write integers to a text file, in the format of print_chararr
+/////////////////////////////////////////////////////////////
+void write_intarr_textfile( const char outfile[],
+    int A[], int N )
+{
+  FILE *fp;
+  int i;
+
+  // check for output filename
+  if ( outfile == NULL ) {
+    fprintf(stderr, "NULL file name\n");
+    return;
+  }
+
+  // check for file existence
+  fp = fopen(outfile,"w");
+  if ( !fp ) {
+    fprintf(stderr, "cannot open file for write %s\n",outfile);
+  }
+  else {
+    fprintf(fp,"%d\n",N);
+    for (i=0; i<N; i++) fprintf(fp,"%d ",A[i]);
+    fprintf(fp,"\n");
+    fclose(fp);
   }
 }
 
@@ -254,41 +331,580 @@ void bubble_sort_chararr(char **arr, int n) {
 #  define ALWAYS_INLINE
 #endif
 
-ALWAYS_INLINE static inline void swap_char_pointer(char** restrict a, char** restrict b) {
-    char* tmp = *a;
-    *a = *b;
-    *b = tmp;
-}
-
 /////////////////////////////////////////////////////////////
+// sorting methods
+//
+// Every method is defined for any type of array elements representing words,
+// by DEFINE_WORD_SORTS(SUFFIX, TYPE), using the following functions,
+// which must be defined for the type first:
+//   compare_SUFFIX(a, b, depth): strcmp of two words sharing their first depth characters
+//   char_at_SUFFIX(a, depth): character of a word at depth, which is 0 past its end
+//   lcp_from_SUFFIX(a, b, h): longest common prefix of two words sharing h characters
+//
+// bubble sort
+// source: https://ko.wikipedia.org/
+//
 // insertion sort
 // source: https://en.wikipedia.org/wiki/Insertion_sort#Algorithm
+//
+// selection sort
+// source: https://en.wikipedia.org/wiki/Selection_sort#Implementations
+//
+// MSD radix sort
+// source: https://en.wikipedia.org/wiki/Radix_sort#Most_significant_digit
+// and Karkkainen, Rantala: "Engineering Radix Sort for Strings" (byte caching);
+// every word's next character is read only once, so that the distribution
+// doesn't chase the pointers again. Bucket 0 holds the words which have ended,
+// so they're already in place. All other buckets are sorted by their next character,
+// the largest one in a loop and the rest recursively, which bounds the recursion depth.
+//
+// multikey quicksort
+// source: Bentley, Sedgewick: "Fast Algorithms for Sorting and Searching Strings";
+// partitions on a single character position at a time, so words equal at depth
+// only need to be compared past it - unless they've all ended.
+//
+// LCP-aware merge sort
+// source: Ng, Kakehi: "Merging String Sequences by Longest Common Prefixes";
+// stable merge sort, which also stores the LCP of every word with the previous one.
+// While merging, the heads of both runs remember their LCP with the last merged word:
+// the head sharing more with it is the smaller one, and words are only compared
+// past the prefix they're known to share. Ties are taken from the left run.
 /////////////////////////////////////////////////////////////
-void insertion_sort_chararr(char **arr, int n) {
-    for (int i = 1; i < n; ++i) {
-        for (int j = i; j > 0 && strcmp(arr[j - 1], arr[j]) > 0; --j) {
-            swap_char_pointer(arr + j - 1, arr + j);
-        }
+
+// buckets with at most this many words are insertion sorted instead
+#define RADIX_INSERTION_CUTOFF 32
+
+// runs with at most this many words are insertion sorted instead
+#define MERGE_INSERTION_CUTOFF 16
+
+// sample sort: the words are spread into buckets between splitters picked
+// from a sample, which are then sorted concurrently by the MSD radix sort;
+// there are more buckets than threads to balance the load, and every bucket
+// is represented by this many sampled words
+#define SAMPLE_BUCKETS_PER_THREAD 4
+#define SAMPLE_OVERSAMPLING 32
+
+// smaller arrays are sorted sequentially
+#define SAMPLE_SORT_MIN 4096
+
+#define MAX_SORT_THREADS 256
+
+// wall-clock duration of the sample, scatter and local sort phases
+// of the last sample sort, as clock() adds up the time of all threads
+static double sample_phase_times[3];
+
+static double wall_time_in_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// number of threads of the sample sort: SORT_THREADS from the environment,
+// or the number of online CPUs
+static int sort_thread_count(void) {
+    char const *env = getenv("SORT_THREADS");
+    long threads = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > MAX_SORT_THREADS) threads = MAX_SORT_THREADS;
+    return (int)threads;
+}
+
+#define DEFINE_SAMPLE_SORT(SUFFIX, TYPE)                                                         \
+    /* state shared by the threads of a sample sort; bucket 2i holds the words */                \
+    /* between splitters i-1 and i, and bucket 2i+1 the words equal to splitter i */             \
+    struct sample_sort_##SUFFIX {                                                                \
+        TYPE *arr;                                                                               \
+        TYPE *aux;                                                                               \
+        int n, threads;                                                                          \
+        TYPE *splitters;                                                                         \
+        int n_splitters, n_buckets;                                                              \
+        unsigned short *bucket_of;                                                               \
+        int *offsets;                                                                            \
+        int *bucket_start;                                                                       \
+        unsigned char *keys;                                                                     \
+        pthread_mutex_t lock;                                                                    \
+        int next_bucket;                                                                         \
+    };                                                                                           \
+                                                                                                 \
+    struct sample_task_##SUFFIX {                                                                \
+        pthread_t thread;                                                                        \
+        struct sample_sort_##SUFFIX *s;                                                          \
+        int id;                                                                                  \
+    };                                                                                           \
+                                                                                                 \
+    static int sample_bucket_##SUFFIX(struct sample_sort_##SUFFIX const *s, TYPE word) {         \
+        int lo = 0, hi = s->n_splitters;                                                         \
+        while (lo < hi) {                                                                        \
+            int mid = (lo + hi) / 2;                                                             \
+            if (compare_##SUFFIX(s->splitters[mid], word, 0) < 0)                                \
+                lo = mid + 1;                                                                    \
+            else                                                                                 \
+                hi = mid;                                                                        \
+        }                                                                                        \
+        if (lo < s->n_splitters && compare_##SUFFIX(s->splitters[lo], word, 0) == 0) {           \
+            return 2 * lo + 1;                                                                   \
+        }                                                                                        \
+        return 2 * lo;                                                                           \
+    }                                                                                            \
+                                                                                                 \
+    /* counts the words of the thread's slice in every bucket */                                 \
+    static void *sample_classify_##SUFFIX(void *arg) {                                           \
+        struct sample_task_##SUFFIX *task = arg;                                                 \
+        struct sample_sort_##SUFFIX *s = task->s;                                                \
+        int *count = s->offsets + (size_t)task->id * s->n_buckets;                               \
+        int begin = (int)((long long)s->n * task->id / s->threads);                              \
+        int end = (int)((long long)s->n * (task->id + 1) / s->threads);                          \
+        for (int i = begin; i < end; ++i) {                                                      \
+            int b = sample_bucket_##SUFFIX(s, s->arr[i]);                                        \
+            s->bucket_of[i] = (unsigned short)b;                                                 \
+            count[b]++;                                                                          \
+        }                                                                                        \
+        return NULL;                                                                             \
+    }                                                                                            \
+                                                                                                 \
+    /* moves the words of the thread's slice to its part of every bucket */                      \
+    static void *sample_scatter_##SUFFIX(void *arg) {                                            \
+        struct sample_task_##SUFFIX *task = arg;                                                 \
+        struct sample_sort_##SUFFIX *s = task->s;                                                \
+        int *next = s->offsets + (size_t)task->id * s->n_buckets;                                \
+        int begin = (int)((long long)s->n * task->id / s->threads);                              \
+        int end = (int)((long long)s->n * (task->id + 1) / s->threads);                          \
+        for (int i = begin; i < end; ++i) s->aux[next[s->bucket_of[i]]++] = s->arr[i];           \
+        return NULL;                                                                             \
+    }                                                                                            \
+                                                                                                 \
+    /* moves buckets, taken one at a time, back to their place in arr and sorts them there; */   \
+    /* buckets are disjoint ranges, so each one uses its own range of aux and keys as scratch */ \
+    static void *sample_sort_buckets_##SUFFIX(void *arg) {                                       \
+        struct sample_task_##SUFFIX *task = arg;                                                 \
+        struct sample_sort_##SUFFIX *s = task->s;                                                \
+                                                                                                 \
+        for (;;) {                                                                               \
+            pthread_mutex_lock(&s->lock);                                                        \
+            int b = s->next_bucket++;                                                            \
+            pthread_mutex_unlock(&s->lock);                                                      \
+            if (b >= s->n_buckets) break;                                                        \
+                                                                                                 \
+            int start = s->bucket_start[b], n = s->bucket_start[b + 1] - start;                  \
+            for (int i = start; i < start + n; ++i) s->arr[i] = s->aux[i];                       \
+            if (b % 2 == 0) {                                                                    \
+                msd_radix_sort_range_##SUFFIX(s->arr + start, s->aux + start, s->keys + start,   \
+                                              n, 0);                                             \
+            }                                                                                    \
+        }                                                                                        \
+        return NULL;                                                                             \
+    }                                                                                            \
+                                                                                                 \
+    /* runs a phase of the sample sort on all threads, and returns its wall-clock duration */    \
+    static double sample_phase_##SUFFIX(struct sample_sort_##SUFFIX *s,                          \
+                                        struct sample_task_##SUFFIX *tasks,                      \
+                                        void *(*phase)(void *)) {                                \
+        double start = wall_time_in_sec();                                                       \
+        for (int t = 1; t < s->threads; ++t) {                                                   \
+            if (pthread_create(&tasks[t].thread, NULL, phase, tasks + t) != 0) {                 \
+                fprintf(stderr, "cannot create a thread\n");                                     \
+                exit(1);                                                                         \
+            }                                                                                    \
+        }                                                                                        \
+        phase(tasks);                                                                            \
+        for (int t = 1; t < s->threads; ++t) pthread_join(tasks[t].thread, NULL);                \
+        return wall_time_in_sec() - start;                                                       \
+    }                                                                                            \
+                                                                                                 \
+    void sample_sort_##SUFFIX(TYPE *arr, int n) {                                                \
+        if (n < SAMPLE_SORT_MIN) {                                                               \
+            msd_radix_sort_##SUFFIX(arr, n);                                                     \
+            return;                                                                              \
+        }                                                                                        \
+                                                                                                 \
+        struct sample_sort_##SUFFIX s = {.arr = arr, .n = n, .threads = sort_thread_count()};    \
+        double start = wall_time_in_sec();                                                       \
+                                                                                                 \
+        /* pick the splitters from a sorted sample of words at pseudo-random positions */        \
+        int buckets = s.threads * SAMPLE_BUCKETS_PER_THREAD;                                     \
+        int sample_size = buckets * SAMPLE_OVERSAMPLING;                                         \
+        TYPE *sample = (TYPE*)malloc_c(sizeof(TYPE) * sample_size);                              \
+        unsigned long long state = 0x9E3779B97F4A7C15ULL;                                        \
+        for (int i = 0; i < sample_size; ++i) {                                                  \
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;                     \
+            sample[i] = arr[(state >> 33) % (unsigned long long)n];                              \
+        }                                                                                        \
+        msd_radix_sort_##SUFFIX(sample, sample_size);                                            \
+                                                                                                 \
+        s.splitters = (TYPE*)malloc_c(sizeof(TYPE) * buckets);                                   \
+        for (int i = SAMPLE_OVERSAMPLING; i < sample_size; i += SAMPLE_OVERSAMPLING) {           \
+            if (s.n_splitters == 0 ||                                                            \
+                compare_##SUFFIX(s.splitters[s.n_splitters - 1], sample[i], 0) != 0) {           \
+                s.splitters[s.n_splitters++] = sample[i];                                        \
+            }                                                                                    \
+        }                                                                                        \
+        free(sample);                                                                            \
+        s.n_buckets = 2 * s.n_splitters + 1;                                                     \
+        sample_phase_times[0] = wall_time_in_sec() - start;                                      \
+                                                                                                 \
+        /* count the words of every thread in every bucket, */                                   \
+        /* turn the counts into offsets and scatter the words */                                 \
+        size_t tasks_size = sizeof(struct sample_task_##SUFFIX) * s.threads;                     \
+        struct sample_task_##SUFFIX *tasks = (struct sample_task_##SUFFIX*)malloc_c(tasks_size); \
+        for (int t = 0; t < s.threads; ++t) {                                                    \
+            tasks[t].s = &s;                                                                     \
+            tasks[t].id = t;                                                                     \
+        }                                                                                        \
+        s.aux = (TYPE*)malloc_c(sizeof(TYPE) * n);                                               \
+        s.bucket_of = (unsigned short*)malloc_c(sizeof(unsigned short) * n);                     \
+        s.offsets = (int*)malloc_c(sizeof(int) * s.threads * s.n_buckets);                       \
+        s.bucket_start = (int*)malloc_c(sizeof(int) * (s.n_buckets + 1));                        \
+        for (int i = 0; i < s.threads * s.n_buckets; ++i) s.offsets[i] = 0;                      \
+                                                                                                 \
+        sample_phase_times[1] = sample_phase_##SUFFIX(&s, tasks, sample_classify_##SUFFIX);      \
+        double scatter_start = wall_time_in_sec();                                               \
+        int offset = 0;                                                                          \
+        for (int b = 0; b < s.n_buckets; ++b) {                                                  \
+            s.bucket_start[b] = offset;                                                          \
+            int size = 0;                                                                        \
+            for (int t = 0; t < s.threads; ++t) {                                                \
+                int count = s.offsets[t * s.n_buckets + b];                                      \
+                s.offsets[t * s.n_buckets + b] = offset + size;                                  \
+                size += count;                                                                   \
+            }                                                                                    \
+            offset += size;                                                                      \
+        }                                                                                        \
+        s.bucket_start[s.n_buckets] = offset;                                                    \
+        sample_phase_times[1] += wall_time_in_sec() - scatter_start;                             \
+        sample_phase_times[1] += sample_phase_##SUFFIX(&s, tasks, sample_scatter_##SUFFIX);      \
+                                                                                                 \
+        /* sort the buckets and move them back in order */                                       \
+        s.keys = (unsigned char*)malloc_c(n);                                                    \
+        pthread_mutex_init(&s.lock, NULL);                                                       \
+        sample_phase_times[2] = sample_phase_##SUFFIX(&s, tasks, sample_sort_buckets_##SUFFIX);  \
+        pthread_mutex_destroy(&s.lock);                                                          \
+                                                                                                 \
+        free(s.splitters);                                                                       \
+        free(tasks);                                                                             \
+        free(s.aux);                                                                             \
+        free(s.bucket_of);                                                                       \
+        free(s.offsets);                                                                         \
+        free(s.bucket_start);                                                                    \
+        free(s.keys);                                                                            \
     }
+
+#define DEFINE_WORD_SORTS(SUFFIX, TYPE)                                                           \
+    ALWAYS_INLINE static inline void swap_##SUFFIX(TYPE *a, TYPE *b) {                            \
+        TYPE tmp = *a;                                                                            \
+        *a = *b;                                                                                  \
+        *b = tmp;                                                                                 \
+    }                                                                                             \
+                                                                                                  \
+    void bubble_sort_##SUFFIX(TYPE *arr, int n) {                                                 \
+        for (int i = n - 1; i > 0; i--) {                                                         \
+            for (int j = 0; j < i; j++) {                                                         \
+                if (compare_##SUFFIX(arr[j], arr[j + 1], 0) > 0) {                                \
+                    swap_##SUFFIX(arr + j, arr + j + 1);                                          \
+                }                                                                                 \
+            }                                                                                     \
+        }                                                                                         \
+    }                                                                                             \
+                                                                                                  \
+    /* insertion sort of words sharing their first depth characters */                            \
+    static void insertion_sort_##SUFFIX##_from(TYPE *arr, int n, int depth) {                     \
+        for (int i = 1; i < n; ++i) {                                                             \
+            for (int j = i; j > 0 && compare_##SUFFIX(arr[j - 1], arr[j], depth) > 0; --j) {      \
+                swap_##SUFFIX(arr + j - 1, arr + j);                                              \
+            }                                                                                     \
+        }                                                                                         \
+    }                                                                                             \
+                                                                                                  \
+    void insertion_sort_##SUFFIX(TYPE *arr, int n) { insertion_sort_##SUFFIX##_from(arr, n, 0); } \
+                                                                                                  \
+    void selection_sort_##SUFFIX(TYPE *arr, int n) {                                              \
+        for (int i = 0; i < n - 1; ++i) {                                                         \
+            int j_min = i;                                                                        \
+            for (int j = i + 1; j < n; ++j) {                                                     \
+                if (compare_##SUFFIX(arr[j], arr[j_min], 0) < 0) j_min = j;                       \
+            }                                                                                     \
+            if (j_min != i) swap_##SUFFIX(arr + j_min, arr + i);                                  \
+        }                                                                                         \
+    }                                                                                             \
+                                                                                                  \
+    /* aux and keys are scratch space for n words and n characters */                             \
+    static void msd_radix_sort_range_##SUFFIX(TYPE *arr, TYPE *aux, unsigned char *keys, int n,   \
+                                              int depth) {                                        \
+        while (n > RADIX_INSERTION_CUTOFF) {                                                      \
+            int count[256] = {0};                                                                 \
+            for (int i = 0; i < n; ++i) {                                                         \
+                keys[i] = char_at_##SUFFIX(arr[i], depth);                                        \
+                count[keys[i]]++;                                                                 \
+            }                                                                                     \
+                                                                                                  \
+            int start[256], next[256];                                                            \
+            start[0] = 0;                                                                         \
+            for (int c = 1; c < 256; ++c) start[c] = start[c - 1] + count[c - 1];                 \
+            for (int c = 0; c < 256; ++c) next[c] = start[c];                                     \
+            for (int i = 0; i < n; ++i) aux[next[keys[i]]++] = arr[i];                            \
+            for (int i = 0; i < n; ++i) arr[i] = aux[i];                                          \
+                                                                                                  \
+            int largest = 1;                                                                      \
+            for (int c = 2; c < 256; ++c) {                                                       \
+                if (count[c] > count[largest]) largest = c;                                       \
+            }                                                                                     \
+            for (int c = 1; c < 256; ++c) {                                                       \
+                if (c != largest && count[c] > 1) {                                               \
+                    msd_radix_sort_range_##SUFFIX(arr + start[c], aux, keys, count[c],            \
+                                                  depth + 1);                                     \
+                }                                                                                 \
+            }                                                                                     \
+                                                                                                  \
+            arr += start[largest];                                                                \
+            n = count[largest];                                                                   \
+            depth++;                                                                              \
+        }                                                                                         \
+                                                                                                  \
+        insertion_sort_##SUFFIX##_from(arr, n, depth);                                            \
+    }                                                                                             \
+                                                                                                  \
+    void msd_radix_sort_##SUFFIX(TYPE *arr, int n) {                                              \
+        if (n < 2) return;                                                                        \
+        TYPE *aux = (TYPE*)malloc_c(sizeof(TYPE) * n);                                            \
+        unsigned char *keys = (unsigned char*)malloc_c(n);                                        \
+        msd_radix_sort_range_##SUFFIX(arr, aux, keys, n, 0);                                      \
+        free(aux);                                                                                \
+        free(keys);                                                                               \
+    }                                                                                             \
+                                                                                                  \
+    /* index of the median of three words, by their character at depth */                         \
+    static int median_of_three_##SUFFIX(TYPE *arr, int a, int b, int c, int depth) {              \
+        unsigned char va = char_at_##SUFFIX(arr[a], depth), vb = char_at_##SUFFIX(arr[b], depth), \
+                      vc = char_at_##SUFFIX(arr[c], depth);                                       \
+        if (va < vb) return vb < vc ? b : (va < vc ? c : a);                                      \
+        return va < vc ? a : (vb < vc ? c : b);                                                   \
+    }                                                                                             \
+                                                                                                  \
+    static void multikey_quicksort_range_##SUFFIX(TYPE *arr, int n, int depth) {                  \
+        while (n > RADIX_INSERTION_CUTOFF) {                                                      \
+            swap_##SUFFIX(arr, arr + median_of_three_##SUFFIX(arr, 0, n / 2, n - 1, depth));      \
+            unsigned char pivot = char_at_##SUFFIX(arr[0], depth);                                \
+                                                                                                  \
+            /* three-way partition: [0, lt) < pivot, [lt, gt) == pivot, [gt, n) > pivot */        \
+            int lt = 0, i = 1, gt = n;                                                            \
+            while (i < gt) {                                                                      \
+                unsigned char c = char_at_##SUFFIX(arr[i], depth);                                \
+                if (c < pivot) {                                                                  \
+                    swap_##SUFFIX(arr + lt++, arr + i++);                                         \
+                } else if (c > pivot) {                                                           \
+                    swap_##SUFFIX(arr + i, arr + --gt);                                           \
+                } else {                                                                          \
+                    i++;                                                                          \
+                }                                                                                 \
+            }                                                                                     \
+                                                                                                  \
+            multikey_quicksort_range_##SUFFIX(arr, lt, depth);                                    \
+            multikey_quicksort_range_##SUFFIX(arr + gt, n - gt, depth);                           \
+                                                                                                  \
+            if (pivot == 0) return;                                                               \
+            arr += lt;                                                                            \
+            n = gt - lt;                                                                          \
+            depth++;                                                                              \
+        }                                                                                         \
+                                                                                                  \
+        insertion_sort_##SUFFIX##_from(arr, n, depth);                                            \
+    }                                                                                             \
+                                                                                                  \
+    void multikey_quicksort_##SUFFIX(TYPE *arr, int n) {                                          \
+        multikey_quicksort_range_##SUFFIX(arr, n, 0);                                             \
+    }                                                                                             \
+                                                                                                  \
+    /* stores the LCP of every word of a sorted array with the previous one (0 for the first) */  \
+    void lcp_of_sorted_##SUFFIX(TYPE *arr, int *lcp, int n) {                                     \
+        for (int i = 0; i < n; ++i) {                                                             \
+            lcp[i] = i > 0 ? lcp_from_##SUFFIX(arr[i - 1], arr[i], 0) : 0;                        \
+        }                                                                                         \
+    }                                                                                             \
+                                                                                                  \
+    static void lcp_merge_##SUFFIX(TYPE *a, int *a_lcp, int na, TYPE *b, int *b_lcp, int nb,      \
+                                   TYPE *out, int *out_lcp) {                                     \
+        int i = 0, j = 0, k = 0;                                                                  \
+        int ha = 0, hb = 0;                                                                       \
+                                                                                                  \
+        while (i < na && j < nb) {                                                                \
+            bool take_a = ha > hb;                                                                \
+            if (ha == hb) {                                                                       \
+                int h = lcp_from_##SUFFIX(a[i], b[j], ha);                                        \
+                take_a = char_at_##SUFFIX(a[i], h) <= char_at_##SUFFIX(b[j], h);                  \
+                if (take_a)                                                                       \
+                    hb = h;                                                                       \
+                else                                                                              \
+                    ha = h;                                                                       \
+            }                                                                                     \
+                                                                                                  \
+            if (take_a) {                                                                         \
+                out[k] = a[i];                                                                    \
+                out_lcp[k++] = ha;                                                                \
+                if (++i < na) ha = a_lcp[i];                                                      \
+            } else {                                                                              \
+                out[k] = b[j];                                                                    \
+                out_lcp[k++] = hb;                                                                \
+                if (++j < nb) hb = b_lcp[j];                                                      \
+            }                                                                                     \
+        }                                                                                         \
+                                                                                                  \
+        for (; i < na; ++i, ++k) {                                                                \
+            out[k] = a[i];                                                                        \
+            out_lcp[k] = ha;                                                                      \
+            if (i + 1 < na) ha = a_lcp[i + 1];                                                    \
+        }                                                                                         \
+        for (; j < nb; ++j, ++k) {                                                                \
+            out[k] = b[j];                                                                        \
+            out_lcp[k] = hb;                                                                      \
+            if (j + 1 < nb) hb = b_lcp[j + 1];                                                    \
+        }                                                                                         \
+    }                                                                                             \
+                                                                                                  \
+    static void lcp_merge_sort_range_##SUFFIX(TYPE *arr, int *lcp, TYPE *aux, int *aux_lcp,       \
+                                              int n) {                                            \
+        if (n <= MERGE_INSERTION_CUTOFF) {                                                        \
+            insertion_sort_##SUFFIX(arr, n);                                                      \
+            lcp_of_sorted_##SUFFIX(arr, lcp, n);                                                  \
+            return;                                                                               \
+        }                                                                                         \
+                                                                                                  \
+        int mid = n / 2;                                                                          \
+        lcp_merge_sort_range_##SUFFIX(arr, lcp, aux, aux_lcp, mid);                               \
+        lcp_merge_sort_range_##SUFFIX(arr + mid, lcp + mid, aux, aux_lcp, n - mid);               \
+        lcp_merge_##SUFFIX(arr, lcp, mid, arr + mid, lcp + mid, n - mid, aux, aux_lcp);           \
+                                                                                                  \
+        for (int i = 0; i < n; ++i) {                                                             \
+            arr[i] = aux[i];                                                                      \
+            lcp[i] = aux_lcp[i];                                                                  \
+        }                                                                                         \
+    }                                                                                             \
+                                                                                                  \
+    void lcp_merge_sort_##SUFFIX(TYPE *arr, int *lcp, int n) {                                    \
+        if (n < 1) return;                                                                        \
+        TYPE *aux = (TYPE*)malloc_c(sizeof(TYPE) * n);                                            \
+        int *aux_lcp = (int*)malloc_c(sizeof(int) * n);                                           \
+        lcp_merge_sort_range_##SUFFIX(arr, lcp, aux, aux_lcp, n);                                 \
+        free(aux);                                                                                \
+        free(aux_lcp);                                                                            \
+    }                                                                                             \
+                                                                                                  \
+    DEFINE_SAMPLE_SORT(SUFFIX, TYPE)                                                              \
+                                                                                                  \
+    /* sorts the words with the given method; method 6 also allocates and fills *lcp */           \
+    void sort_##SUFFIX(TYPE *arr, int n, int method, int **lcp) {                                 \
+        switch (method) {                                                                         \
+            case 1:                                                                               \
+                bubble_sort_##SUFFIX(arr, n);                                                     \
+                break;                                                                            \
+            case 2:                                                                               \
+                insertion_sort_##SUFFIX(arr, n);                                                  \
+                break;                                                                            \
+            case 3:                                                                               \
+                selection_sort_##SUFFIX(arr, n);                                                  \
+                break;                                                                            \
+            case 4:                                                                               \
+                msd_radix_sort_##SUFFIX(arr, n);                                                  \
+                break;                                                                            \
+            case 5:                                                                               \
+                multikey_quicksort_##SUFFIX(arr, n);                                              \
+                break;                                                                            \
+            case 6:                                                                               \
+                *lcp = (int*)malloc_c(sizeof(int) * n);                                           \
+                lcp_merge_sort_##SUFFIX(arr, *lcp, n);                                            \
+                break;                                                                            \
+            case 7:                                                                               \
+                sample_sort_##SUFFIX(arr, n);                                                     \
+                break;                                                                            \
+        }                                                                                         \
+    }
+
+/////////////////////////////////////////////////////////////
+// words as plain char pointers
+/////////////////////////////////////////////////////////////
+
+ALWAYS_INLINE static inline int compare_chararr(char *a, char *b, int depth) {
+    COUNT_COMPARISON();
+    return strcmp(a + depth, b + depth);
+}
+
+ALWAYS_INLINE static inline unsigned char char_at_chararr(char *word, int depth) {
+    return (unsigned char)word[depth];
+}
+
+ALWAYS_INLINE static inline int lcp_from_chararr(char *a, char *b, int h) {
+    COUNT_COMPARISON();
+    while (a[h] != '\0' && a[h] == b[h]) h++;
+    return h;
 }
 
+DEFINE_WORD_SORTS(chararr, char*)
+
 /////////////////////////////////////////////////////////////
-// selection sort
-// source: https://en.wikipedia.org/wiki/Selection_sort#Implementations
+// words with their first 8 characters cached as a big-endian integer
+// most comparisons only read the prefixes, which are stored next to
+// the pointers in a dense array, instead of following the pointers
+// to the words scattered in memory
 /////////////////////////////////////////////////////////////
-void selection_sort_chararr(char **arr, int n) {
-    for (int i = 0; i < n - 1; ++i) {
-        int j_min = i;
-        for (int j = i + 1; j < n; ++j) {
-            if (strcmp(arr[j], arr[j_min]) < 0) {
-                j_min = j;
-            }
-        }
-
-        if (j_min != i) swap_char_pointer(arr + j_min, arr + i);
+
+#define PREFIX_LEN 8
+
+struct prefixed_word {
+    unsigned long long prefix;  // first PREFIX_LEN characters, padded with 0s
+    char *word;
+};
+
+// number of leading equal characters of two prefixes, whose XOR is x != 0
+ALWAYS_INLINE static inline int equal_prefix_chars(unsigned long long x) {
+#ifdef __GNUC__
+    return __builtin_clzll(x) / 8;
+#else
+    int n = 0;
+    while (((x >> (8 * (PREFIX_LEN - 1 - n))) & 0xFF) == 0) n++;
+    return n;
+#endif
+}
+
+struct prefixed_word *make_prefixed_words(char **A, int N) {
+    struct prefixed_word *P = (struct prefixed_word*)malloc_c(sizeof(struct prefixed_word) * N);
+    for (int i = 0; i < N; ++i) {
+        unsigned long long prefix = 0;
+        for (int k = 0; k < PREFIX_LEN && A[i][k] != '\0'; ++k)
+            prefix |= (unsigned long long)(unsigned char)A[i][k] << (8 * (PREFIX_LEN - 1 - k));
+        P[i].prefix = prefix;
+        P[i].word = A[i];
+    }
+    return P;
+}
+
+ALWAYS_INLINE static inline int compare_prefixed(struct prefixed_word a, struct prefixed_word b,
+                                                 int depth) {
+    COUNT_COMPARISON();
+    if (depth < PREFIX_LEN) {
+        if (a.prefix != b.prefix) return a.prefix < b.prefix ? -1 : 1;
+        if ((a.prefix & 0xFF) == 0) return 0;  // both words end within the prefix
+        depth = PREFIX_LEN;
     }
+    return strcmp(a.word + depth, b.word + depth);
 }
 
+ALWAYS_INLINE static inline unsigned char char_at_prefixed(struct prefixed_word a, int depth) {
+    if (depth < PREFIX_LEN) return (unsigned char)(a.prefix >> (8 * (PREFIX_LEN - 1 - depth)));
+    return (unsigned char)a.word[depth];
+}
+
+ALWAYS_INLINE static inline int lcp_from_prefixed(struct prefixed_word a, struct prefixed_word b,
+                                                  int h) {
+    COUNT_COMPARISON();
+    if (h < PREFIX_LEN) {
+        if (a.prefix != b.prefix) return equal_prefix_chars(a.prefix ^ b.prefix);
+        if ((a.prefix & 0xFF) == 0) return strlen(a.word);  // equal words shorter than the prefix
+        h = PREFIX_LEN;
+    }
+    while (a.word[h] != '\0' && a.word[h] == b.word[h]) h++;
+    return h;
+}
+
+DEFINE_WORD_SORTS(prefixed, struct prefixed_word)
+
 /////////////////////////////////////////////////////////////
 // main function
 /////////////////////////////////////////////////////////////
@@ -296,52 +912,81 @@ int main(int argc, char *argv[])
 {
   int n, num_words;
   int method;
+  bool prefixed;	// sort {prefix, word} pairs instead of words
   char **A;	// to store data to be sorted
-  char **B;	// to store re-ordered strings
+  char *words;	// arena with the words of A
+  int *L = NULL;	// LCPs of the sorted words, if computed by the method
+  struct prefixed_word *P;	// A with cached prefixes, in the prefixed mode
 
-  if ( argc != 5 ) {
+  if ( argc != 5 && argc != 6 ) {
     fprintf(stderr, "argc = %d\n",argc);
-    fprintf(stderr, "usage: %s method infile sortedfile revsortedfile\n",
+    fprintf(stderr, "usage: %s method infile sortedfile revsortedfile [lcpfile]\n",
 	argv[0]);
     fprintf(stderr, " method = 1 --- bubble sort\n"
 	" method = 2 --- insertion sort\n"
-	" method = 3 --- selection sort\n");
+	" method = 3 --- selection sort\n"
+	" method = 4 --- MSD radix sort\n"
+	" method = 5 --- multikey quicksort\n"
+	" method = 6 --- LCP merge sort\n"
+	" method = 7 --- parallel sample sort, on SORT_THREADS threads\n"
+	"                (default: number of CPUs)\n"
+	" prefix the method with p (like p4) to sort the words together with\n"
+	" their first 8 characters, which makes most comparisons cache-local\n"
+	" lcpfile gets the longest common prefix of every sorted word\n"
+	" with the previous one\n");
     exit(0);
   }
 
-  method = atoi(argv[1]);
+  prefixed = argv[1][0] == 'p';
+  method = atoi(argv[1] + prefixed);
 
   /* read text file of words:
    * number_of_intergers word1 word2 ... */
-  A = read_chararr_textfile(argv[2], &num_words);
+  A = read_chararr_textfile(argv[2], &num_words, &words);
 
   // start timer
   reset_timer();
 
   // sort the string array A
-  switch ( method ) {
-    case 1: bubble_sort_chararr(A, num_words);
-	    break;
-    case 2: insertion_sort_chararr(A, num_words);
-	    break;
-    case 3: selection_sort_chararr(A, num_words);
-	    break;
+  if ( prefixed ) {
+    // building the prefixes is part of the measured sorting time
+    P = make_prefixed_words(A, num_words);
+    sort_prefixed(P, num_words, method, &L);
+    for (n=0; n<num_words; n++) A[n] = P[n].word;
+    free(P);
+  }
+  else {
+    sort_chararr(A, num_words, method, &L);
   }
-
-  // reverse the order of words in A and store it to B
-  B = (char**) malloc_c(sizeof(char*)*num_words);
-  for (n=0; n<num_words; n++) B[num_words-n-1] = strdup_c(A[n]);
 
   // display computation time and memory usage
   // NOTE: file I/O time not included
   fprintf(stdout,"TIME: %.5f seconds\n", elapsed_time_in_sec());
   fprintf(stdout,"MEMORY USAGE: %ld bytes\n", used_memory_in_bytes());
+#ifdef COUNT_COMPARISONS
+  fprintf(stdout,"COMPARISONS: %llu\n", comparisons);
+#endif
+  if ( method == 7 ) {
+    // wall-clock time of the phases, as TIME adds up the time of all threads
+    fprintf(stdout,"TIME (sample): %.5f seconds\n", sample_phase_times[0]);
+    fprintf(stdout,"TIME (scatter): %.5f seconds\n", sample_phase_times[1]);
+    fprintf(stdout,"TIME (local sort): %.5f seconds\n", sample_phase_times[2]);
+  }
 
   // save results
   write_chararr_textfile(argv[3], A, num_words);
-  write_chararr_textfile(argv[4], B, num_words);
+  // the reverse-sorted words are written straight from A
+  write_chararr_textfile_reversed(argv[4], A, num_words);
+  if ( argc == 6 ) {
+    // other methods don't compute LCPs, so find them after the measurement
+    if ( !L ) {
+      L = (int*) malloc_c(sizeof(int)*num_words);
+      lcp_of_sorted_chararr(A, L, num_words);
+    }
+    write_intarr_textfile(argv[5], L, num_words);
+  }
 
-  // free A and B
-  free_chararr(A, num_words);
-  free_chararr(B, num_words);
+  // free A
+  free_chararr(A, words);
+  free(L);
 }
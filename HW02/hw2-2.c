@@ -16,6 +16,7 @@
 // TO INTENTIONALLY MAKE COMPUTATION TIME MUCH LARGER
 
 #include<stdlib.h>
+#include<stdbool.h>
 #include<string.h>	// string library
 #include<time.h>	// time library
 
@@ -24,10 +25,15 @@
 // so that reading and writing the word into the container
 // should take CONTAINER_SIZE/2 comparisons on the average
 // --- to intentionally make search and other operations too much slow
+// compile with -DMEMOIZE_WORD_LOCATION to record the location of the word
+// next to the box when it is stored, so that searching takes no scan
 #define CONTAINER_SIZE	4096
 //#define CONTAINER_SIZE	8192
 struct container {
   char box[CONTAINER_SIZE];
+#ifdef MEMOIZE_WORD_LOCATION
+  int loc;	// location of the word in the box, set by assign_container
+#endif
 };
 
 int assign_container(struct container *a, const char s[]) {
@@ -45,17 +51,24 @@ int assign_container(struct container *a, const char s[]) {
   for (i=0; i<CONTAINER_SIZE; i++) a->box[i] = ' ';	// space
   for (i=0; i<word_size; i++) a->box[loc+i] = s[i];	// word
   a->box[loc+word_size] = '\0';	// termination character
+#ifdef MEMOIZE_WORD_LOCATION
+  a->loc = loc;
+#endif
 
   return 1;
 }
 
 // internal function - DO NOT USE
 char *search_container(struct container *a) {
+#ifdef MEMOIZE_WORD_LOCATION
+  return a->box+a->loc;
+#else
   int i;
   for (i=0; i<CONTAINER_SIZE; i++) {
     if ( a->box[i] != ' ' ) return a->box+i;
   }
   return NULL;	// not stored
+#endif
 }
 
 int copy_container(struct container *a, struct container *b) {
@@ -69,7 +82,15 @@ void swap_container(struct container *a, struct container *b,
   copy_container(b,temp);	// b = temp
 }
 
+#ifdef COUNT_COMPARISONS
+// number of compared pairs of words, displayed after the memory usage
+static unsigned long long comparisons = 0;
+#endif
+
 int compare_container(struct container *a, struct container *b) {
+#ifdef COUNT_COMPARISONS
+  comparisons++;
+#endif
   return strcmp(search_container(a), search_container(b));
 }
 
@@ -184,6 +205,16 @@ void print_container_arr( FILE *fp, struct container A[], int N )
   fprintf(fp,"\n");
 }
 
+// prints the array from the last word to the first one,
+// in the format of print_container_arr
+void print_container_arr_reversed( FILE *fp, struct container A[], int N )
+{
+  int i;
+  fprintf(fp,"%d\n",N);
+  for (i=N-1; i>=0; i--) fprintf(fp,"%s ",search_container(A+i));
+  fprintf(fp,"\n");
+}
+
 /////////////////////////////////////////////////////////////
 // read words from a text file
 // NOTE: using malloc_c() and strdup_c()
@@ -290,6 +321,32 @@ void write_container_arr_textfile( const char outfile[],
   }
 }
 
+/////////////////////////////////////////////////////////////
+// write words to a text file in reverse order
+// streams A backwards, instead of writing a reversed copy of it
+/////////////////////////////////////////////////////////////
+void write_container_arr_textfile_reversed( const char outfile[],
+    struct container A[], int N )
+{
+  FILE *fp;
+
+  // check for output filename
+  if ( outfile == NULL ) {
+    fprintf(stderr, "NULL file name\n");
+    return;
+  }
+
+  // check for file existence
+  fp = fopen(outfile,"w");
+  if ( !fp ) {
+    fprintf(stderr, "cannot open file for write %s\n",outfile);
+  }
+  else {
+    print_container_arr_reversed(fp,A,N);
+    fclose(fp);
+  }
+}
+
 /////////////////////////////////////////////////////////////
 // bubble sort
 // source: https://ko.wikipedia.org/
@@ -340,15 +397,119 @@ void selection_sort_container_arr(struct container *arr, int n) {
     }
 }
 
+/////////////////////////////////////////////////////////////
+// indirect sorting
+// every container is searched for its word only once, into a compact array
+// of handles, which is sorted instead of the containers. The sorted order
+// is then applied to the containers by following the cycles of the
+// permutation, so that every container is copied at most once.
+/////////////////////////////////////////////////////////////
+struct container_handle {
+    char *word;  // word inside its container, which stays in place until permuting
+    int index;   // position of the container in the array
+};
+
+int compare_handle(struct container_handle *a, struct container_handle *b) {
+#ifdef COUNT_COMPARISONS
+    comparisons++;
+#endif
+    return strcmp(a->word, b->word);
+}
+
+void swap_handle(struct container_handle *a, struct container_handle *b) {
+    struct container_handle temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+struct container_handle *make_handle_arr(struct container *arr, int n) {
+    struct container_handle *handles =
+        (struct container_handle*)malloc_c(sizeof(struct container_handle) * n);
+    for (int i = 0; i < n; ++i) {
+        handles[i].word = search_container(arr + i);
+        handles[i].index = i;
+    }
+    return handles;
+}
+
+// moves the containers, so that arr[i] becomes the container at handles[i].index;
+// every cycle of the permutation is rotated through a single temporary container
+// NOTE: the handles are no longer valid afterwards
+void permute_container_arr(struct container *arr, struct container_handle *handles, int n) {
+    struct container temp;
+    for (int start = 0; start < n; ++start) {
+        if (handles[start].index == start) continue;  // already in place
+
+        int i = start;
+        copy_container(&temp, arr + start);
+        while (handles[i].index != start) {
+            int from = handles[i].index;
+            copy_container(arr + i, arr + from);
+            handles[i].index = i;
+            i = from;
+        }
+        copy_container(arr + i, &temp);
+        handles[i].index = i;
+    }
+}
+
+void bubble_sort_handle_arr(struct container_handle *arr, int n) {
+    for (int i = n - 1; i > 0; --i) {
+        for (int j = 0; j < i; ++j) {
+            if (compare_handle(arr + j, arr + j + 1) > 0) swap_handle(arr + j, arr + j + 1);
+        }
+    }
+}
+
+void insertion_sort_handle_arr(struct container_handle *arr, int n) {
+    for (int i = 1; i < n; ++i) {
+        for (int j = i; j > 0 && compare_handle(arr + j - 1, arr + j) > 0; --j) {
+            swap_handle(arr + j - 1, arr + j);
+        }
+    }
+}
+
+void selection_sort_handle_arr(struct container_handle *arr, int n) {
+    for (int i = 0; i < n - 1; ++i) {
+        int j_min = i;
+        for (int j = i + 1; j < n; ++j) {
+            if (compare_handle(arr + j, arr + j_min) < 0) {
+                j_min = j;
+            }
+        }
+
+        if (j_min != i) swap_handle(arr + j_min, arr + i);
+    }
+}
+
+// sorts the containers with the given method over their handles,
+// then moves every container to its place once
+void indirect_sort_container_arr(struct container *arr, int n, int method) {
+    struct container_handle *handles = make_handle_arr(arr, n);
+    switch (method) {
+        case 1:
+            bubble_sort_handle_arr(handles, n);
+            break;
+        case 2:
+            insertion_sort_handle_arr(handles, n);
+            break;
+        case 3:
+            selection_sort_handle_arr(handles, n);
+            break;
+    }
+    permute_container_arr(arr, handles, n);
+    free(handles);
+}
+
 /////////////////////////////////////////////////////////////
 // main function
 /////////////////////////////////////////////////////////////
 int main(int argc, char *argv[])
 {
-  int n, num_words;
+  int num_words;
   int method;
+  bool indirect;	// sort handles to the words, then move the containers
   struct container *A;	// to store data to be sorted
-  struct container *B;	// to store re-ordered strings
 
   if ( argc != 5 ) {
     fprintf(stderr, "argc = %d\n",argc);
@@ -356,11 +517,14 @@ int main(int argc, char *argv[])
 	argv[0]);
     fprintf(stderr, " method = 1 --- bubble sort\n"
 	" method = 2 --- insertion sort\n"
-	" method = 3 --- selection sort\n");
+	" method = 3 --- selection sort\n"
+	" prefix the method with i (like i2) to sort handles to the words,\n"
+	" and then move every container only once\n");
     exit(0);
   }
 
-  method = atoi(argv[1]);
+  indirect = argv[1][0] == 'i';
+  method = atoi(argv[1] + indirect);
 
   /* read text file of words:
    * number_of_intergers word1 word2 ... */
@@ -370,8 +534,8 @@ int main(int argc, char *argv[])
   reset_timer();
 
   // sort the string array A
-  // sort the string array A
-  switch ( method ) {
+  if ( indirect ) indirect_sort_container_arr(A, num_words, method);
+  else switch ( method ) {
     case 1: bubble_sort_container_arr(A, num_words);
 	    break;
     case 2: insertion_sort_container_arr(A, num_words);
@@ -380,22 +544,20 @@ int main(int argc, char *argv[])
 	    break;
   }
 
-  // reverse the order of words in A and store it to B
-  B = (struct container*) malloc_c(sizeof(struct container)*num_words);
-  for (n=0; n<num_words; n++)
-    copy_container(B+num_words-n-1, A+n);
-
   // display computation time and memory usage
   // NOTE: file I/O time not included
   fprintf(stdout,"TIME: %.5f seconds\n", elapsed_time_in_sec());
   fprintf(stdout,"MEMORY USAGE: %ld bytes\n", used_memory_in_bytes());
+#ifdef COUNT_COMPARISONS
+  fprintf(stdout,"COMPARISONS: %llu\n", comparisons);
+#endif
 
   // save results
   write_container_arr_textfile(argv[3], A, num_words);
-  write_container_arr_textfile(argv[4], B, num_words);
+  // the reverse-sorted words are written straight from A
+  write_container_arr_textfile_reversed(argv[4], A, num_words);
 
-  // free A and B
-  free(B);
+  // free A
   free(A);
 }
 
@@ -26,10 +26,15 @@
 // so that reading and writing the word into the container
 // should take CONTAINER_SIZE/2 comparisons on the average
 // --- to intentionally make search and other operations too much slow
+// compile with -DMEMOIZE_WORD_LOCATION to record the location of the word
+// next to the box when it is stored, so that searching takes no scan
 #define CONTAINER_SIZE	4096
 //#define CONTAINER_SIZE	8192
 struct container {
   char box[CONTAINER_SIZE];
+#ifdef MEMOIZE_WORD_LOCATION
+  int loc;	// location of the word in the box, set by assign_container
+#endif
 };
 
 int assign_container(struct container *a, const char s[]) {
@@ -47,17 +52,24 @@ int assign_container(struct container *a, const char s[]) {
   for (i=0; i<CONTAINER_SIZE; i++) a->box[i] = ' ';	// space
   for (i=0; i<word_size; i++) a->box[loc+i] = s[i];	// word
   a->box[loc+word_size] = '\0';	// termination character
+#ifdef MEMOIZE_WORD_LOCATION
+  a->loc = loc;
+#endif
 
   return 1;
 }
 
 // internal function - DO NOT USE
 char *search_container(struct container *a) {
+#ifdef MEMOIZE_WORD_LOCATION
+  return a->box+a->loc;
+#else
   int i;
   for (i=0; i<CONTAINER_SIZE; i++) {
     if ( a->box[i] != ' ' ) return a->box+i;
   }
   return NULL;	// not stored
+#endif
 }
 
 int copy_container(struct container *a, struct container *b) {
@@ -71,7 +83,15 @@ void swap_container(struct container *a, struct container *b,
   copy_container(b,temp);	// b = temp
 }
 
+#ifdef COUNT_COMPARISONS
+// number of compared pairs of words, displayed after the memory usage
+static unsigned long long comparisons = 0;
+#endif
+
 int compare_container(struct container *a, struct container *b) {
+#ifdef COUNT_COMPARISONS
+  comparisons++;
+#endif
   return strcmp(search_container(a), search_container(b));
 }
 
@@ -328,20 +348,112 @@ void quick_sort_container_arr(struct container *C, int n) {
     quick_sort_container_range(C, 0, n-1);
 }
 
+/////////////////////////////////////////////////////////////
+// indirect sorting
+// every container is searched for its word only once, into a compact array
+// of handles, which is sorted instead of the containers. The sorted order
+// is then applied to the containers by following the cycles of the
+// permutation, so that every container is copied at most once.
+/////////////////////////////////////////////////////////////
+struct container_handle {
+    char *word;  // word inside its container, which stays in place until permuting
+    int index;   // position of the container in the array
+};
+
+int compare_handle(struct container_handle *a, struct container_handle *b) {
+#ifdef COUNT_COMPARISONS
+    comparisons++;
+#endif
+    return strcmp(a->word, b->word);
+}
+
+void swap_handle(struct container_handle *a, struct container_handle *b) {
+    struct container_handle temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+struct container_handle *make_handle_arr(struct container *arr, int n) {
+    struct container_handle *handles =
+        (struct container_handle*)malloc_c(sizeof(struct container_handle) * n);
+    for (int i = 0; i < n; ++i) {
+        handles[i].word = search_container(arr + i);
+        handles[i].index = i;
+    }
+    return handles;
+}
+
+// moves the containers, so that arr[i] becomes the container at handles[i].index;
+// every cycle of the permutation is rotated through a single temporary container
+// NOTE: the handles are no longer valid afterwards
+void permute_container_arr(struct container *arr, struct container_handle *handles, int n) {
+    struct container temp;
+    for (int start = 0; start < n; ++start) {
+        if (handles[start].index == start) continue;  // already in place
+
+        int i = start;
+        copy_container(&temp, arr + start);
+        while (handles[i].index != start) {
+            int from = handles[i].index;
+            copy_container(arr + i, arr + from);
+            handles[i].index = i;
+            i = from;
+        }
+        copy_container(arr + i, &temp);
+        handles[i].index = i;
+    }
+}
+
+int partition_handle_range(struct container_handle* c, int low, int high) {
+    struct container_handle pivot = c[(low + high)/2];
+
+    int left = low - 1;
+    int right = high + 1;
+
+    while (1) {
+        do left++; while (compare_handle(c + left, &pivot) < 0);
+        do right--; while (compare_handle(c + right, &pivot) > 0);
+        if (left >= right) return right;
+        swap_handle(c + left, c + right);
+    }
+}
+
+void quick_sort_handle_range(struct container_handle* c, int low, int high) {
+    if (low >= 0 && high >= 0 && low < high) {
+        int pivot_index = partition_handle_range(c, low, high);
+        quick_sort_handle_range(c, low, pivot_index);
+        quick_sort_handle_range(c, pivot_index + 1, high);
+    }
+}
+
+// quick sorts the containers over their handles,
+// then moves every container to its place once
+void indirect_quick_sort_container_arr(struct container *C, int n) {
+    struct container_handle *handles = make_handle_arr(C, n);
+    quick_sort_handle_range(handles, 0, n-1);
+    permute_container_arr(C, handles, n);
+    free(handles);
+}
+
 /////////////////////////////////////////////////////////////
 // main function
 /////////////////////////////////////////////////////////////
 int main(int argc, char *argv[])
 {
   int num_words;
+  int indirect;	// sort handles to the words, then move the containers
   struct container *A;	// to store data to be sorted
   struct container *M3;	// to store median +/- 1
 
-  if ( argc != 3 ) {
+  indirect = argc == 4 && strcmp(argv[1], "-i") == 0;
+  if ( argc != 3 + indirect ) {
     fprintf(stderr, "argc = %d\n",argc);
-    fprintf(stderr, "usage: %s infile sortedfile\n", argv[0]);
+    fprintf(stderr, "usage: %s [-i] infile sortedfile\n", argv[0]);
+    fprintf(stderr, " -i --- sort handles to the words,\n"
+	"        and then move every container only once\n");
     exit(0);
   }
+  argv += indirect;	// skip the flag
 
   /* read text file of words:
    * number_of_intergers word1 word2 ... */
@@ -354,7 +466,8 @@ int main(int argc, char *argv[])
   reset_timer();
 
   // quick sort the string array A
-  quick_sort_container_arr(A, num_words);
+  if ( indirect ) indirect_quick_sort_container_arr(A, num_words);
+  else quick_sort_container_arr(A, num_words);
 
   // copy median-1, median, median+1
   copy_container(M3,   A+(num_words+1)/2-2);
@@ -369,6 +482,9 @@ int main(int argc, char *argv[])
   // NOTE: file I/O time not included
   fprintf(stdout,"TIME: %.5f seconds\n", elapsed_time_in_sec());
   fprintf(stdout,"MEMORY USAGE: %ld bytes\n", used_memory_in_bytes());
+#ifdef COUNT_COMPARISONS
+  fprintf(stdout,"COMPARISONS: %llu\n", comparisons);
+#endif
 
   // save results
   write_container_arr_textfile(argv[2], A, num_words);
@@ -26,10 +26,15 @@
 // so that reading and writing the word into the container
 // should take CONTAINER_SIZE/2 comparisons on the average
 // --- to intentionally make search and other operations too much slow
+// compile with -DMEMOIZE_WORD_LOCATION to record the location of the word
+// next to the box when it is stored, so that searching takes no scan
 #define CONTAINER_SIZE	4096
 //#define CONTAINER_SIZE	8192
 struct container {
   char box[CONTAINER_SIZE];
+#ifdef MEMOIZE_WORD_LOCATION
+  int loc;	// location of the word in the box, set by assign_container
+#endif
 };
 
 int assign_container(struct container *a, const char s[]) {
@@ -47,17 +52,24 @@ int assign_container(struct container *a, const char s[]) {
   for (i=0; i<CONTAINER_SIZE; i++) a->box[i] = ' ';	// space
   for (i=0; i<word_size; i++) a->box[loc+i] = s[i];	// word
   a->box[loc+word_size] = '\0';	// termination character
+#ifdef MEMOIZE_WORD_LOCATION
+  a->loc = loc;
+#endif
 
   return 1;
 }
 
 // internal function - DO NOT USE
 char *search_container(struct container *a) {
+#ifdef MEMOIZE_WORD_LOCATION
+  return a->box+a->loc;
+#else
   int i;
   for (i=0; i<CONTAINER_SIZE; i++) {
     if ( a->box[i] != ' ' ) return a->box+i;
   }
   return NULL;	// not stored
+#endif
 }
 
 int copy_container(struct container *a, struct container *b) {
@@ -71,7 +83,15 @@ void swap_container(struct container *a, struct container *b,
   copy_container(b,temp);	// b = temp
 }
 
+#ifdef COUNT_COMPARISONS
+// number of compared pairs of words, displayed after the memory usage
+static unsigned long long comparisons = 0;
+#endif
+
 int compare_container(struct container *a, struct container *b) {
+#ifdef COUNT_COMPARISONS
+  comparisons++;
+#endif
   return strcmp(search_container(a), search_container(b));
 }
 
@@ -383,6 +403,9 @@ int main(int argc, char *argv[])
   // NOTE: file I/O time not included
   fprintf(stdout,"TIME: %.5f seconds\n", elapsed_time_in_sec());
   fprintf(stdout,"MEMORY USAGE: %ld bytes\n", used_memory_in_bytes());
+#ifdef COUNT_COMPARISONS
+  fprintf(stdout,"COMPARISONS: %llu\n", comparisons);
+#endif
 
   // free A
   free(A);
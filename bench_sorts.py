@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+"""Benchmarks the sorting methods of HW02 and HW03 over generated inputs.
+
+Every program is built twice: normally, for timing, and with -DCOUNT_COMPARISONS,
+for a single extra run counting the compared pairs of words. The time of a run is the
+TIME reported by the program itself, so it excludes the file I/O.
+
+Examples:
+    ./bench_sorts.py --sizes 100 1000 10000 --repeats 5 --format csv -o bench.csv
+    ./bench_sorts.py --methods hw2-2 hw3 --cflags "-O2 -DMEMOIZE_WORD_LOCATION"
+"""
+from argparse import ArgumentParser
+from dataclasses import dataclass, field
+from pathlib import Path
+from random import Random
+from statistics import median, stdev
+from tempfile import TemporaryDirectory
+from typing import Callable, Optional, TextIO
+import json
+import os
+import re
+import subprocess
+import sys
+
+ROOT = Path(__file__).resolve().parent
+LETTERS = "abcdefghijklmnopqrstuvwxyz"
+
+
+@dataclass
+class Method:
+    name: str
+    source: str
+    args: list[str]  # method arguments passed before the input file
+    outputs: int  # number of output files after the input file
+    quadratic: bool = False
+    median3: bool = False  # prints the median and its neighbours instead of sorting
+
+
+METHODS = [
+    *(Method(f"hw2-1:{p}{m}{n}", "HW02/hw2-1.c", [f"{p}{m}"], 2, m <= 3)
+      for p in ("", "p")
+      for m, n in [(1, "-bubble"), (2, "-insertion"), (3, "-selection"), (4, "-msd-radix"),
+                   (5, "-multikey"), (6, "-lcp-merge"), (7, "-sample")]),
+    *(Method(f"hw2-2:{p}{m}{n}", "HW02/hw2-2.c", [f"{p}{m}"], 2, True)
+      for p in ("", "i")
+      for m, n in [(1, "-bubble"), (2, "-insertion"), (3, "-selection")]),
+    Method("hw3-1:quicksort", "HW03/hw3-1.c", [], 1),
+    Method("hw3-1:quicksort-indirect", "HW03/hw3-1.c", ["-i"], 1),
+    Method("hw3-2:quickselect-median3", "HW03/hw3-2.c", [], 0, median3=True),
+    Method("hw3-3:heapsort", "HW03/hw3-3.c", [], 1),
+    Method("hw3-4:heap-median3", "HW03/hw3-4.c", [], 0, median3=True),
+]
+
+
+def random_word(rng: Random, lo: int = 3, hi: int = 12) -> str:
+    return "".join(rng.choices(LETTERS, k=rng.randint(lo, hi)))
+
+
+def organ_pipe(words: list[str]) -> list[str]:
+    words = sorted(words)
+    return words[0::2] + words[1::2][::-1]
+
+
+def few_unique(rng: Random, n: int) -> list[str]:
+    pool = [random_word(rng) for _ in range(10)]
+    return [rng.choice(pool) for _ in range(n)]
+
+
+def long_prefix(rng: Random, n: int) -> list[str]:
+    # Words differ only after 100 shared characters (words are at most 255 characters)
+    prefix = "x" * 100
+    return [prefix + random_word(rng, 1, 8) for _ in range(n)]
+
+
+DISTRIBUTIONS: dict[str, Callable[[Random, int], list[str]]] = {
+    "random": lambda rng, n: [random_word(rng) for _ in range(n)],
+    "sorted": lambda rng, n: sorted(random_word(rng) for _ in range(n)),
+    "reversed": lambda rng, n: sorted((random_word(rng) for _ in range(n)), reverse=True),
+    "few-unique": few_unique,
+    "organ-pipe": lambda rng, n: organ_pipe([random_word(rng) for _ in range(n)]),
+    "long-prefix": long_prefix,
+}
+
+
+COLUMNS = ["method", "distribution", "size", "seed", "repeats", "median_s", "stddev_s", "min_s",
+           "comparisons", "memory_bytes"]
+
+
+@dataclass
+class Run:
+    time: float
+    memory: int
+    comparisons: Optional[int] = None
+    stdout: str = ""
+
+
+@dataclass
+class Result:
+    method: str
+    distribution: str
+    size: int
+    seed: int
+    times: list[float] = field(default_factory=list)
+    memory: int = 0
+    comparisons: Optional[int] = None
+
+    def row(self) -> dict[str, object]:
+        return {
+            "method": self.method,
+            "distribution": self.distribution,
+            "size": self.size,
+            "seed": self.seed,
+            "repeats": len(self.times),
+            # Programs report times with 5 decimal places
+            "median_s": round(median(self.times), 6),
+            "stddev_s": round(stdev(self.times), 6) if len(self.times) > 1 else 0.0,
+            "min_s": min(self.times),
+            "comparisons": self.comparisons,
+            "memory_bytes": self.memory,
+        }
+
+
+def build(source: str, out: Path, cc: str, cflags: list[str]) -> None:
+    cmd = [cc, *cflags, "-o", str(out), str(ROOT / source), "-lpthread"]
+    subprocess.run(cmd, check=True)
+
+
+def run(binary: Path, method: Method, infile: Path, workdir: Path) -> tuple[Run, list[Path]]:
+    outputs = [workdir / f"out{i}.txt" for i in range(method.outputs)]
+    cmd = [str(binary), *method.args, str(infile), *map(str, outputs)]
+    stdout = subprocess.run(cmd, check=True, capture_output=True, text=True).stdout
+
+    def field_of(name: str) -> Optional[str]:
+        match = re.search(rf"^{name}: (\S+)", stdout, re.MULTILINE)
+        return match[1] if match else None
+
+    time, memory, comparisons = field_of("TIME"), field_of("MEMORY USAGE"), field_of("COMPARISONS")
+    if time is None or memory is None:
+        raise RuntimeError(f"unexpected output of {' '.join(cmd)}:\n{stdout}")
+    comparisons_count = int(comparisons) if comparisons else None
+    return Run(float(time), int(memory), comparisons_count, stdout), outputs
+
+
+def check_result(method: Method, words: list[str], run: Run, outputs: list[Path]) -> None:
+    # Words are plain ASCII, so Python orders them just like strcmp
+    expected = sorted(words)
+    if method.median3:
+        # Same positions as the programs use, which need at least 3 words
+        if len(words) < 3:
+            return
+        k = (len(words) + 1) // 2
+        match = re.search(r"^MEDIAN-1, MEDIAN, MEDIAN\+1: (.*)$", run.stdout, re.MULTILINE)
+        if not match or match[1].split() != expected[k - 2:k + 1]:
+            raise RuntimeError(f"{method.name} did not find the median of its input")
+    elif outputs:
+        got = outputs[0].read_text().split()
+        if got[1:] != expected:
+            raise RuntimeError(f"{method.name} did not sort its input")
+
+
+def write_results(f: TextIO, rows: list[dict[str, object]], format: str) -> None:
+    if format == "json":
+        json.dump(rows, f, indent=2)
+        f.write("\n")
+    else:
+        f.write(",".join(COLUMNS) + "\n")
+        for row in rows:
+            f.write(",".join("" if row[c] is None else str(row[c]) for c in COLUMNS) + "\n")
+
+
+def main() -> None:
+    arg_parser = ArgumentParser(description=__doc__.partition("\n")[0])
+    arg_parser.add_argument("--sizes", type=int, nargs="+", default=[100, 1000, 10000])
+    arg_parser.add_argument("--distributions", nargs="+", choices=DISTRIBUTIONS,
+                            default=list(DISTRIBUTIONS))
+    arg_parser.add_argument("--methods", nargs="+", metavar="PATTERN", default=[""],
+                            help="run methods whose names contain any of the patterns")
+    arg_parser.add_argument("--seed", type=int, default=1)
+    arg_parser.add_argument("--warmups", type=int, default=1)
+    arg_parser.add_argument("--repeats", type=int, default=5)
+    arg_parser.add_argument("--max-quadratic-size", type=int, default=10000,
+                            help="skip bubble/insertion/selection sorts of larger inputs")
+    arg_parser.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    arg_parser.add_argument("--cflags", default="-O2", help="compiler flags (default: -O2)")
+    arg_parser.add_argument("--format", choices=["csv", "json"], default="csv")
+    arg_parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = arg_parser.parse_args()
+    if args.repeats < 1:
+        arg_parser.error("at least one repeat is needed")
+
+    methods = [m for m in METHODS if any(p in m.name for p in args.methods)]
+    if not methods:
+        arg_parser.error("no method matches the given patterns")
+
+    results: list[Result] = []
+    with TemporaryDirectory(prefix="bench_sorts") as tmp:
+        workdir = Path(tmp)
+
+        # Build every program in both variants
+        binaries: dict[tuple[str, bool], Path] = {}
+        for source in dict.fromkeys(m.source for m in methods):
+            for counting in (False, True):
+                out = workdir / (Path(source).stem + ("-count" if counting else ""))
+                flags = args.cflags.split() + (["-DCOUNT_COMPARISONS"] if counting else [])
+                build(source, out, args.cc, flags)
+                binaries[source, counting] = out
+
+        for size in args.sizes:
+            for distribution in args.distributions:
+                rng = Random(f"{args.seed}:{distribution}:{size}")
+                words = DISTRIBUTIONS[distribution](rng, size)
+                infile = workdir / f"in-{distribution}-{size}.txt"
+                infile.write_text(f"{size}\n{' '.join(words)}\n")
+
+                for method in methods:
+                    if method.quadratic and size > args.max_quadratic_size:
+                        continue
+                    print(f"{method.name} {distribution} {size}", file=sys.stderr)
+                    result = Result(method.name, distribution, size, args.seed)
+
+                    counted, outputs = run(binaries[method.source, True], method, infile,
+                                           workdir)
+                    check_result(method, words, counted, outputs)
+                    result.comparisons = counted.comparisons
+
+                    for _ in range(args.warmups):
+                        run(binaries[method.source, False], method, infile, workdir)
+                    for _ in range(args.repeats):
+                        timed, _ = run(binaries[method.source, False], method, infile,
+                                       workdir)
+                        result.times.append(timed.time)
+                        result.memory = timed.memory
+                    results.append(result)
+
+    rows = [r.row() for r in results]
+    if args.output:
+        with open(args.output, "w") as f:
+            write_results(f, rows, args.format)
+    else:
+        write_results(sys.stdout, rows, args.format)
+
+
+if __name__ == "__main__":
+    main()